@@ -0,0 +1,122 @@
+/*
+ * dfu_rt.c
+ *
+ * DFU runtime interface for user applications
+ *
+ * Implements the DFU 1.1 run-time mode requests (DETACH, GETSTATUS and
+ * GETSTATE) on one interface so host tools can switch a running
+ * application to the bootloader without touching the button. Everything
+ * is on the control endpoint.
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <no2usb/usb.h>
+#include <no2usb/usb_proto.h>
+
+#include "dfu_rt.h"
+
+
+#define DFU_REQ_DETACH		0
+#define DFU_REQ_GETSTATUS	3
+#define DFU_REQ_GETSTATE	5
+
+#define DFU_STATE_APP_IDLE	0
+#define DFU_STATE_APP_DETACH	1
+
+
+static struct {
+	uint8_t intf;
+	uint8_t state;
+	uint8_t buf[6];
+} g_dfu_rt;
+
+
+static bool
+_dfu_rt_detach_done(struct usb_xfer *xfer)
+{
+	dfu_rt_cb_detach();
+	return true;
+}
+
+static enum usb_fnd_resp
+_dfu_rt_ctrl_req(struct usb_ctrl_req *req, struct usb_xfer *xfer)
+{
+	/* Class requests to our interface only */
+	if (USB_REQ_TYPE_RCPT(req) != (USB_REQ_TYPE_CLASS | USB_REQ_RCPT_INTF))
+		return USB_FND_CONTINUE;
+
+	if (req->wIndex != g_dfu_rt.intf)
+		return USB_FND_CONTINUE;
+
+	switch (req->bRequest)
+	{
+	case DFU_REQ_DETACH:
+		/* Reboot once the status stage is done */
+		g_dfu_rt.state = DFU_STATE_APP_DETACH;
+		xfer->cb_done = _dfu_rt_detach_done;
+		return USB_FND_SUCCESS;
+
+	case DFU_REQ_GETSTATUS:
+		/* Status OK, no poll timeout, state, no string */
+		g_dfu_rt.buf[0] = 0;
+		g_dfu_rt.buf[1] = 0;
+		g_dfu_rt.buf[2] = 0;
+		g_dfu_rt.buf[3] = 0;
+		g_dfu_rt.buf[4] = g_dfu_rt.state;
+		g_dfu_rt.buf[5] = 0;
+
+		xfer->data = g_dfu_rt.buf;
+		xfer->len  = 6;
+		return USB_FND_SUCCESS;
+
+	case DFU_REQ_GETSTATE:
+		g_dfu_rt.buf[0] = g_dfu_rt.state;
+
+		xfer->data = g_dfu_rt.buf;
+		xfer->len  = 1;
+		return USB_FND_SUCCESS;
+
+	default:
+		return USB_FND_ERROR;
+	}
+}
+
+static enum usb_fnd_resp
+_dfu_rt_set_intf(const struct usb_intf_desc *base, const struct usb_intf_desc *sel)
+{
+	if (base->bInterfaceNumber != g_dfu_rt.intf)
+		return USB_FND_CONTINUE;
+
+	return (sel->bAlternateSetting == 0) ? USB_FND_SUCCESS : USB_FND_ERROR;
+}
+
+static enum usb_fnd_resp
+_dfu_rt_get_intf(const struct usb_intf_desc *base, uint8_t *alt)
+{
+	if (base->bInterfaceNumber != g_dfu_rt.intf)
+		return USB_FND_CONTINUE;
+
+	*alt = 0;
+	return USB_FND_SUCCESS;
+}
+
+static struct usb_fn_drv _dfu_rt_drv = {
+	.ctrl_req = _dfu_rt_ctrl_req,
+	.set_intf = _dfu_rt_set_intf,
+	.get_intf = _dfu_rt_get_intf,
+};
+
+
+void
+dfu_rt_init(uint8_t intf)
+{
+	g_dfu_rt.intf  = intf;
+	g_dfu_rt.state = DFU_STATE_APP_IDLE;
+
+	usb_register_function_driver(&_dfu_rt_drv);
+}
@@ -0,0 +1,57 @@
+/*
+ * dfu_rt.h
+ *
+ * DFU runtime interface for user applications (no2usb function driver)
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <no2usb/usb_proto.h>
+#include <no2usb/usb_dfu_proto.h>
+
+
+/* Interface + functional descriptor, to be put in the configuration */
+struct usb_dfu_rt_desc {
+	struct usb_intf_desc intf;
+	struct usb_dfu_func_desc func;
+} __attribute__((packed));
+
+/*
+ * Will Detach : the device re-enumerates by itself in DFU mode, no bus
+ * reset needed. Transfer size is the one of the bootloader.
+ */
+#define USB_DFU_RT_DESC(intf_num, str_idx) {			\
+	.intf = {						\
+		.bLength		= sizeof(struct usb_intf_desc),	\
+		.bDescriptorType	= USB_DT_INTF,		\
+		.bInterfaceNumber	= (intf_num),		\
+		.bAlternateSetting	= 0,			\
+		.bNumEndpoints		= 0,			\
+		.bInterfaceClass	= 0xfe,			\
+		.bInterfaceSubClass	= 0x01,			\
+		.bInterfaceProtocol	= 0x01,			\
+		.iInterface		= (str_idx),		\
+	},							\
+	.func = {						\
+		.bLength		= sizeof(struct usb_dfu_func_desc), \
+		.bDescriptorType	= USB_DFU_DT_FUNC,	\
+		.bmAttributes		= 0x0f,			\
+		.wDetachTimeOut		= 1000,			\
+		.wTransferSize		= 4096,			\
+		.bcdDFUVersion		= 0x0101,		\
+	},							\
+}
+
+/* Register the driver for the given interface number */
+void dfu_rt_init(uint8_t intf);
+
+/*
+ * Called once the DFU_DETACH request is acknowledged. Must warmboot the
+ * bootloader (image 1), with dfu_rt.v : write (1 << 2) | 1 to its register.
+ */
+void dfu_rt_cb_detach(void);
@@ -26,6 +26,11 @@ void console_init(void)
 	uart_regs->clkdiv = 22;	/* 1 Mbaud with clk=24MHz */
 }
 
+void console_set_div(unsigned div)
+{
+	uart_regs->clkdiv = div;
+}
+
 char getchar(void)
 {
 	int32_t c;
@@ -8,6 +8,7 @@
 #pragma once
 
 void console_init(void);
+void console_set_div(unsigned div);
 
 char getchar(void);
 int  getchar_nowait(void);
@@ -14,6 +14,10 @@ void console_init(void)
 {
 }
 
+void console_set_div(unsigned div)
+{
+}
+
 char getchar(void)
 {
 	while (1);
@@ -27,11 +27,101 @@ extern const struct usb_stack_descriptors dfu_stack_desc;
 struct wb_misc {
 	uint32_t boot;
 	uint32_t led;
+	uint32_t trace;
+	uint32_t uart_idle;	/* ENABLE_UART only */
+	uint32_t _rsvd[4];
+	uint32_t trace_ms[8];
 } __attribute__((packed,aligned(4)));
 
 static volatile struct wb_misc * const misc_regs = (void*)(MISC_BASE);
 
 
+/* Boot milestones (0 is reset release, marked by hardware) */
+enum boot_milestone {
+	BOOT_MS_RESET		= 0,
+	BOOT_MS_ROM_DONE	= 1,	/* Marked by the boot ROM */
+	BOOT_MS_MAIN		= 2,
+	BOOT_MS_USB_CONNECT	= 3,
+	BOOT_MS_FIRST_SETUP	= 4,
+	BOOT_MS_INIT_DONE	= 5,
+};
+
+static inline void
+boot_mark(enum boot_milestone ms)
+{
+	/* Hardware only keeps the first mark of each milestone */
+	misc_regs->trace = ms;
+}
+
+static inline uint32_t
+timestamp(void)
+{
+	/* 31 bits @ 24 MHz */
+	return misc_regs->trace;
+}
+
+
+// ---------------------------------------------------------------------------
+// Flash erase suspend
+// ---------------------------------------------------------------------------
+
+/*
+ * Reads issued while an erase is running are served by suspending the
+ * erase, doing the read and resuming it. Between a resume and the next
+ * suspend, the erase is always given some time to make progress so it
+ * completes even if the host keeps reading.
+ */
+
+#define FLASH_RESUME_HOLDOFF	(24 * 100)	/* 100 us */
+
+static struct {
+	bool can_suspend;
+	bool erasing;
+	uint32_t t_resume;
+} g_flash;
+
+static void
+flash_suspend_init(void)
+{
+	uint8_t manuf[3];
+
+	/* Winbond, GigaDevice and Macronix parts all support 75h / 7Ah */
+	flash_manuf_id(manuf);
+	g_flash.can_suspend = (manuf[0] == 0xef) || (manuf[0] == 0xc8) || (manuf[0] == 0xc2);
+}
+
+static bool
+flash_erase_busy(void)
+{
+	if (g_flash.erasing && !flash_busy())
+		g_flash.erasing = false;
+	return g_flash.erasing;
+}
+
+static bool
+flash_erase_suspend(void)
+{
+	if (!g_flash.can_suspend || !flash_erase_busy())
+		return false;
+
+	/* Guarantee forward progress */
+	while (((timestamp() - g_flash.t_resume) & 0x7fffffff) < FLASH_RESUME_HOLDOFF);
+
+	/* Suspend and wait for it to be effective */
+	flash_suspend();
+	while (flash_busy());
+
+	return true;
+}
+
+static void
+flash_erase_resume(void)
+{
+	flash_resume();
+	g_flash.t_resume = timestamp();
+}
+
+
 static void
 serial_no_init()
 {
@@ -39,13 +129,7 @@ serial_no_init()
 	char *id, *desc;
 	int i;
 
-	flash_manuf_id(buf);
-	printf("Flash Manufacturer : %s\n", hexstr(buf, 3, true));
-
 	flash_unique_id(buf);
-	printf("Flash Unique ID    : %s\n", hexstr(buf, 8, true));
-
-	printf("Flash SR1 %02x / SR2 %02x\n", flash_read_sr(1), flash_read_sr(2));
 
 	/* Overwrite descriptor string */
 		/* In theory in rodata ... but nothing is ro here */
@@ -61,25 +145,778 @@ boot_app(void)
 	/* Force re-enumeration */
 	usb_disconnect();
 
-	/* Boot firmware */
-	misc_regs->boot = (1 << 2) | (2 << 0);
-}
+	/* Wait for any background erase */
+	while (flash_busy());
+
+	/* Boot firmware */
+	misc_regs->boot = (1 << 2) | (2 << 0);
+}
+
+static void
+set_single_led(bool bl_upgrade)
+{
+	/* Set the single led to slow or fast flash */
+	misc_regs->led = (1 << 31) | ((bl_upgrade ? 120 : 600) << 16) | (120 << 0);
+}
+
+
+// ---------------------------------------------------------------------------
+// Read prefetch
+// ---------------------------------------------------------------------------
+
+/*
+ * When the host reads sequentially (DFU upload or raw vendor reads), the
+ * data following the last request is read into a buffer from the main
+ * loop, while the current one is being sent over USB. The next request is
+ * then served from that buffer, finishing the read first if needed.
+ *
+ * Anything modifying the flash invalidates the buffer, and nothing is
+ * read while the flash is busy (erases get suspended for reads, see above).
+ */
+
+#define PF_SIZE		4096	/* One DFU block, see usb_desc_dfu.c */
+#define PF_CHUNK	64	/* Per main loop iteration, keeps usb_poll() latency low */
+
+static struct {
+	uint32_t addr;		/* Prefetch window start */
+	unsigned len;		/* Prefetch window length */
+	unsigned done;		/* Bytes already in buf */
+	uint32_t next;		/* Next address of a sequential access */
+	uint8_t  buf[PF_SIZE] __attribute__((aligned(4)));
+} g_pf;
+
+static void
+pf_invalidate(void)
+{
+	g_pf.len  = 0;
+	g_pf.done = 0;
+	g_pf.next = 0xffffffff;
+}
+
+/* Drops the prefetch window if [addr, addr+len) overlaps it */
+static void
+pf_invalidate_range(uint32_t addr, unsigned len)
+{
+	if ((addr < (g_pf.addr + g_pf.len)) && (g_pf.addr < (addr + len)))
+		pf_invalidate();
+}
+
+static void
+pf_read(void *dst, uint32_t addr, unsigned len)
+{
+	bool seq = (addr == g_pf.next);
+	bool suspended;
+
+	/* Erases get suspended, anything else (page program, erase on a
+	 * flash that can't suspend) has to complete before reading */
+	suspended = flash_erase_suspend();
+	if (!suspended)
+		while (flash_busy());
+
+	if ((addr >= g_pf.addr) && (len <= g_pf.len) && ((addr - g_pf.addr) <= (g_pf.len - len))) {
+		/* Hit, complete the prefetch if needed */
+		unsigned need = addr - g_pf.addr + len;
+
+		if (g_pf.done < need) {
+			flash_read(&g_pf.buf[g_pf.done], g_pf.addr + g_pf.done, need - g_pf.done);
+			g_pf.done = need;
+		}
+
+		memcpy(dst, &g_pf.buf[addr - g_pf.addr], len);
+	} else {
+		/* Miss */
+		flash_read(dst, addr, len);
+	}
+
+	if (suspended)
+		flash_erase_resume();
+
+	/* If access is sequential, start prefetching once we're past the
+	 * current window */
+	g_pf.next = addr + len;
+
+	if (seq && (g_pf.next >= (g_pf.addr + g_pf.len))) {
+		g_pf.addr = g_pf.next;
+		g_pf.len  = PF_SIZE;
+		g_pf.done = 0;
+	}
+}
+
+static void
+pf_poll(void)
+{
+	unsigned l;
+
+	/* Anything to do ? */
+	if (g_pf.done >= g_pf.len)
+		return;
+
+	/* Don't interfere with erases or page programs */
+	if (flash_busy())
+		return;
+
+	/* Read one chunk */
+	l = g_pf.len - g_pf.done;
+	if (l > PF_CHUNK)
+		l = PF_CHUNK;
+
+	flash_read(&g_pf.buf[g_pf.done], g_pf.addr + g_pf.done, l);
+	g_pf.done += l;
+}
+
+
+// ---------------------------------------------------------------------------
+// DFU zones
+// ---------------------------------------------------------------------------
+
+/*
+ * Zones are the alt settings, and so their numbers are what users pass to
+ * dfu-util. They're kept stable : new zones are only ever appended.
+ *
+ * Slot A of the application is 0 and 1 (as before A/B slots existed) and
+ * slot B is 4 and 5. The slot that gets booted is selected by the boot
+ * address of warmboot image 2 in the multiboot header, not by the
+ * bootloader, see utils/ab_update.py
+ *
+ * The bootloader zones (2 and 3) are hidden unless the flash is unlocked,
+ * the following alt settings keep their numbers.
+ *
+ * The combined zone doesn't map to flash, see "Combined image" below.
+ *
+ * Building with DFU_DATA_START adds a "Data" zone from there to the end of
+ * the flash (as discovered, can be well above 16M).
+ */
+
+#define BL_ZONE		2
+#define CMB_ZONE	6
+#define CMB_BASE	0x80000000
+
+#define DATA_ZONE	7
+
+static struct usb_dfu_zone dfu_zones[] = {
+	{ 0x00080000, 0x000a0000 },     /* iCE40 bitstream (slot A) */
+	{ 0x000a0000, 0x000c0000 },     /* RISC-V firmware (slot A) */
+	{ 0x00040000, 0x00060000 },     /* Bootloader bitstream */
+	{ 0x00060000, 0x00080000 },     /* Bootloader firmware  */
+	{ 0x000c0000, 0x000e0000 },     /* iCE40 bitstream (slot B) */
+	{ 0x000e0000, 0x00100000 },     /* RISC-V firmware (slot B) */
+	{ 0x80000000, 0x80200000 },     /* Combined image (virtual) */
+#ifdef DFU_DATA_START
+	{ DFU_DATA_START, 0x01000000 }, /* Data (end set from flash size) */
+#endif
+};
+
+static bool g_bl_upgrade;
+
+static bool
+zone_visible(unsigned zone)
+{
+	return (zone < num_elem(dfu_zones)) &&
+		(g_bl_upgrade || (zone < BL_ZONE) || (zone >= (BL_ZONE + 2)));
+}
+
+/* The flash size is only known if SFDP discovery worked, else assume the
+ * 16M reachable with the default 3 byte addresses */
+static bool
+flash_range_ok(uint32_t addr, uint32_t len)
+{
+	uint32_t size = flash_get_info()->size;
+
+	if (!size)
+		size = 1 << 24;
+
+	return (addr <= size) && (len <= (size - addr));
+}
+
+static void
+zones_init(void)
+{
+#ifdef DFU_DATA_START
+	uint32_t size = flash_get_info()->size;
+
+	if (size)
+		dfu_zones[DATA_ZONE].end = (size > DFU_DATA_START) ? size : DFU_DATA_START;
+#endif
+}
+
+static void
+patch_descriptors(bool bl_upgrade)
+{
+	volatile struct usb_conf_desc *conf = (void*)dfu_stack_desc.conf[0];
+	const unsigned alt_len = sizeof(struct usb_intf_desc) + sizeof(struct usb_dfu_func_desc);
+	unsigned len = sizeof(struct usb_conf_desc) + num_elem(dfu_zones) * alt_len;
+	uint8_t *bl = (uint8_t *)conf + sizeof(struct usb_conf_desc) + BL_ZONE * alt_len;
+
+	if (bl_upgrade)
+		return;
+
+	/* We patch the descriptor ... in RO section but not really RO
+	 * Hide the bootloader alt settings by moving the next ones over them,
+	 * they keep their bAlternateSetting. The resulting gap (0, 1, 4, 5,
+	 * ...) is intentional : alt numbers are stable whatever the mode,
+	 * like the no2dfu.py ZONE_ALIASES. dfu-util `-a <n>` matches n
+	 * against bAlternateSetting, not the position, so it still picks the
+	 * right zone */
+	memmove(bl, bl + 2 * alt_len, len - (BL_ZONE + 2) * alt_len - sizeof(struct usb_conf_desc));
+	conf->wTotalLength = len - 2 * alt_len;
+}
+
+
+// ---------------------------------------------------------------------------
+// Erase ahead
+// ---------------------------------------------------------------------------
+
+/*
+ * The DFU core erases each sector right before programming it. Instead,
+ * as soon as a download starts in a zone, we erase the following sectors
+ * in the background (using the largest erase possible) while the host is
+ * still sending data. When the DFU core gets to a sector that's already
+ * erased, its erase request is a no-op.
+ *
+ * DFU doesn't tell the image length, so this is only done when the host
+ * gave it beforehand (FW_VND_REQ_ERASE_AHEAD) and never past the end of
+ * the image. The hint is valid for one download, until its zero length
+ * block (or an abort).
+ *
+ * Everything in [addr_req, addr_erase) is erased (or being erased) and
+ * not programmed yet. We never go more than ERASE_AHEAD_WINDOW past the
+ * last sector the core asked for.
+ */
+
+#define ERASE_AHEAD_WINDOW	(64 * 1024)
+
+static struct {
+	uint32_t len;		/* Hint for the next download (0 = off) */
+	uint32_t start;		/* Current download (empty when none) */
+	uint32_t end;
+	const struct usb_dfu_zone *zone;
+	uint32_t addr_req;
+	uint32_t addr_erase;
+} g_ea;
+
+static bool
+flash_erase(uint32_t addr, unsigned size)
+{
+	pf_invalidate();
+
+	flash_write_enable();
+	if (!flash_erase_block(addr, size)) {
+		flash_write_disable();
+		return false;
+	}
+
+	g_flash.erasing = true;
+
+	return true;
+}
+
+static unsigned
+flash_erase_largest(uint32_t addr, uint32_t end)
+{
+	/* Always one the flash supports */
+	unsigned size = flash_erase_best(addr, end);
+
+	flash_erase(addr, size);
+
+	return size;
+}
+
+static uint32_t
+erase_ahead_end(void)
+{
+	return (g_ea.end < g_ea.zone->end) ? g_ea.end : g_ea.zone->end;
+}
+
+static void
+erase_ahead_issue(void)
+{
+	g_ea.addr_erase += flash_erase_largest(g_ea.addr_erase, erase_ahead_end());
+}
+
+static void
+erase_ahead_reset(void)
+{
+	g_ea.zone = NULL;
+}
+
+static void
+erase_ahead_hint(uint32_t len)
+{
+	g_ea.len   = len;
+	g_ea.start = 0;
+	g_ea.end   = 0;
+	erase_ahead_reset();
+}
+
+static bool
+erase_ahead_request(uint32_t addr)
+{
+	int i;
+
+	/* Start tracking if it's not the next sector of the current download */
+	if (!g_ea.zone || (addr != g_ea.addr_req)) {
+		g_ea.zone = NULL;
+
+		/* First block of a download with a length hint */
+		if (g_ea.len) {
+			g_ea.start = addr;
+			g_ea.end   = addr + g_ea.len;
+			g_ea.len   = 0;
+		}
+
+		if ((addr < g_ea.start) || (addr >= g_ea.end))
+			return false;
+
+		for (i=0; i<num_elem(dfu_zones); i++)
+			if ((addr >= dfu_zones[i].start) && (addr < dfu_zones[i].end))
+				g_ea.zone = &dfu_zones[i];
+
+		if (!g_ea.zone)
+			return false;
+
+		g_ea.addr_erase = addr;
+	}
+
+	g_ea.addr_req = addr + 4096;
+
+	/* Already done ? */
+	if (addr < g_ea.addr_erase)
+		return true;
+
+	/* Nope, (flash is idle since the core checked) */
+	erase_ahead_issue();
+
+	return true;
+}
+
+static void
+erase_ahead_poll(void)
+{
+	/* Anything left to do ? */
+	if (!g_ea.zone)
+		return;
+
+	if ((g_ea.addr_erase >= erase_ahead_end()) ||
+	    ((g_ea.addr_erase - g_ea.addr_req) >= ERASE_AHEAD_WINDOW))
+		return;
+
+	/* Only when the flash is idle, the DFU core checks busy before
+	 * any operation so it will just wait for us */
+	if (flash_busy())
+		return;
+
+	erase_ahead_issue();
+}
+
+
+// ---------------------------------------------------------------------------
+// Combined image
+// ---------------------------------------------------------------------------
+
+/*
+ * The combined zone receives a sequence of records, each made of a
+ * header page followed by the payload padded to a full page :
+ *
+ *   u32 magic ('no2R'), u8 zone, u8[3] reserved, u32 offset, u32 length
+ *
+ * The payload is written at `offset` (4k aligned) in the given zone. All
+ * the sectors covered by a record are erased when its header is received
+ * (from the busy callback), before the payload arrives. An all 0xff
+ * header page is just padding. See utils/mkcombined.py
+ */
+
+#define CMB_MAGIC	0x52326f6e
+
+struct cmb_hdr {
+	uint32_t magic;
+	uint8_t  zone;
+	uint8_t  _rsvd[3];
+	uint32_t offset;
+	uint32_t len;
+} __attribute__((packed));
+
+enum cmb_error {
+	CMB_OK		= 0,
+	CMB_ERR_MAGIC	= 1,
+	CMB_ERR_ZONE	= 2,
+	CMB_ERR_RANGE	= 3,
+};
+
+static struct {
+	uint32_t addr;
+	uint32_t remain;
+	uint32_t erase_addr;
+	uint32_t erase_end;
+	uint8_t  n_rec;
+	uint8_t  error;
+} g_cmb;
+
+static void
+cmb_start(void)
+{
+	/* Don't let the background erase touch anything we write */
+	erase_ahead_reset();
+	memset(&g_cmb, 0x00, sizeof(g_cmb));
+}
+
+static void
+cmb_header(const void *data, unsigned size)
+{
+	const struct usb_dfu_zone *z;
+	struct cmb_hdr hdr;
+
+	if (size < sizeof(hdr)) {
+		g_cmb.error = CMB_ERR_MAGIC;
+		return;
+	}
+
+	memcpy(&hdr, data, sizeof(hdr));
+
+	/* Padding ? */
+	if (hdr.magic == 0xffffffff)
+		return;
+
+	/* Validate */
+	if (hdr.magic != CMB_MAGIC) {
+		g_cmb.error = CMB_ERR_MAGIC;
+		return;
+	}
+
+	if ((hdr.zone == CMB_ZONE) || !zone_visible(hdr.zone)) {
+		g_cmb.error = CMB_ERR_ZONE;
+		return;
+	}
+
+	z = &dfu_zones[hdr.zone];
+
+	if ((hdr.offset & 0xfff) ||
+	    (hdr.offset > (z->end - z->start)) ||
+	    (hdr.len > (z->end - z->start - hdr.offset))) {
+		g_cmb.error = CMB_ERR_RANGE;
+		return;
+	}
+
+	/* Setup record */
+	g_cmb.addr       = z->start + hdr.offset;
+	g_cmb.remain     = hdr.len;
+	g_cmb.erase_addr = g_cmb.addr;
+	g_cmb.erase_end  = (g_cmb.addr + hdr.len + 0xfff) & ~0xfff;
+	g_cmb.n_rec++;
+}
+
+static void
+cmb_program(const void *data, unsigned size)
+{
+	if (g_cmb.error)
+		return;
+
+	if (!g_cmb.remain) {
+		cmb_header(data, size);
+		return;
+	}
+
+	if (size > g_cmb.remain)
+		size = g_cmb.remain;
+
+	pf_invalidate();
+
+	flash_write_enable();
+	flash_page_program(data, g_cmb.addr, size);
+
+	g_cmb.addr   += size;
+	g_cmb.remain -= size;
+}
+
+static bool
+cmb_erase_poll(void)
+{
+	if (g_cmb.erase_addr >= g_cmb.erase_end)
+		return false;
+
+	g_cmb.erase_addr += flash_erase_largest(g_cmb.erase_addr, g_cmb.erase_end);
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------
+// Flash patch
+// ---------------------------------------------------------------------------
+
+/*
+ * Byte granular flash writes, for small config / calibration updates.
+ * The host sends the data (any alignment, can span two sectors) with a
+ * vendor request and polls for the result. Each affected sector is read
+ * in RAM and the new bytes merged. Then :
+ *  - nothing changed : sector skipped
+ *  - only 1 -> 0 bits : changed pages programmed over, no erase
+ *  - otherwise : sector erased and its non-blank pages programmed back
+ *
+ * It all runs from the main loop, one flash operation per iteration, so
+ * USB keeps being served during the erase.
+ */
+
+#define PATCH_MAX	256
+
+enum patch_state {
+	PATCH_IDLE = 0,
+	PATCH_PENDING,		/* Data received, sector not read yet */
+	PATCH_ERASE,		/* Erase issued */
+	PATCH_PROGRAM,		/* Programming pages */
+};
+
+enum patch_result {
+	PATCH_OK = 0,
+	PATCH_BUSY,
+	PATCH_ERR_ARGS,
+	PATCH_ERR_VERIFY,
+	PATCH_ERR_ERASE,
+};
+
+static struct {
+	enum patch_state  state;
+	enum patch_result result;
+
+	/* Request : LE address then data */
+	uint8_t  req[4 + PATCH_MAX];
+	uint32_t addr;
+	unsigned len;
+	unsigned done;		/* Bytes merged in previous sectors */
+
+	/* Current sector */
+	uint32_t sect;
+	uint16_t pages;		/* Pages left to program (bitmap) */
+
+	/* Stats for the host */
+	uint8_t  n_skipped;
+	uint8_t  n_programmed;
+	uint8_t  n_erased;
+
+	uint8_t  buf[4096] __attribute__((aligned(4)));
+} g_patch;
+
+static bool
+patch_start(struct usb_xfer *xfer)
+{
+	g_patch.addr = g_patch.req[0] | (g_patch.req[1] << 8) | (g_patch.req[2] << 16) | ((uint32_t)g_patch.req[3] << 24);
+	g_patch.len  = xfer->len - 4;
+	g_patch.done = 0;
+
+	g_patch.n_skipped    = 0;
+	g_patch.n_programmed = 0;
+	g_patch.n_erased     = 0;
+
+	/* Only in the flash, and never below the applications (multiboot
+	 * header, stub, bootloader) unless allowed */
+	if (!flash_range_ok(g_patch.addr, g_patch.len) ||
+	    (!g_bl_upgrade && (g_patch.addr < 0x00080000))) {
+		g_patch.result = PATCH_ERR_ARGS;
+		return true;
+	}
+
+	/* Erase ahead and prefetch can't be trusted anymore */
+	erase_ahead_reset();
+	pf_invalidate();
+
+	g_patch.result = PATCH_BUSY;
+	g_patch.state  = PATCH_PENDING;
+
+	return true;
+}
+
+static void
+patch_sector_start(void)
+{
+	uint32_t addr = g_patch.addr + g_patch.done;
+	unsigned ofs, len, i;
+	uint8_t *src = &g_patch.req[4 + g_patch.done];
+	bool changed = false, erase = false;
+
+	g_patch.sect = addr & ~4095;
+	ofs = addr & 4095;
+	len = 4096 - ofs;
+	if (len > (g_patch.len - g_patch.done))
+		len = g_patch.len - g_patch.done;
+
+	/* Read and merge */
+	flash_read(g_patch.buf, g_patch.sect, 4096);
+
+	g_patch.pages = 0;
+
+	for (i=0; i<len; i++) {
+		uint8_t o = g_patch.buf[ofs + i];
+		uint8_t n = src[i];
+		if (o != n) {
+			changed = true;
+			erase  |= (n & ~o) != 0;
+			g_patch.pages |= 1 << ((ofs + i) >> 8);
+		}
+		g_patch.buf[ofs + i] = n;
+	}
+
+	g_patch.done += len;
+
+	if (!changed) {
+		g_patch.n_skipped++;
+		g_patch.state = PATCH_PROGRAM;
+		return;
+	}
+
+	if (erase) {
+		/* Everything not blank needs to be written back */
+		g_patch.pages = 0;
+		for (i=0; i<4096; i++)
+			if (g_patch.buf[i] != 0xff)
+				g_patch.pages |= 1 << (i >> 8);
+
+		if (!flash_erase(g_patch.sect, 4096)) {
+			/* No erase that small on this flash */
+			g_patch.result = PATCH_ERR_ERASE;
+			g_patch.state  = PATCH_IDLE;
+			return;
+		}
+
+		g_patch.n_erased++;
+		g_patch.state = PATCH_ERASE;
+		return;
+	}
+
+	g_patch.n_programmed++;
+	g_patch.state = PATCH_PROGRAM;
+}
+
+static bool
+patch_verify(void)
+{
+	uint32_t addr = g_patch.addr;
+	uint8_t tmp[64];
+	unsigned i, l;
+
+	for (i=0; i<g_patch.len; i+=l) {
+		l = g_patch.len - i;
+		if (l > sizeof(tmp))
+			l = sizeof(tmp);
+		flash_read(tmp, addr + i, l);
+		if (memcmp(tmp, &g_patch.req[4 + i], l))
+			return false;
+	}
+
+	return true;
+}
+
+static void
+patch_poll(void)
+{
+	int page;
+
+	if (g_patch.state == PATCH_IDLE)
+		return;
+
+	/* One flash operation at a time */
+	if (flash_busy())
+		return;
+
+	g_flash.erasing = false;
+
+	switch (g_patch.state)
+	{
+	case PATCH_PENDING:
+		patch_sector_start();
+		break;
+
+	case PATCH_ERASE:
+		g_patch.state = PATCH_PROGRAM;
+		/* fall-through */
+
+	case PATCH_PROGRAM:
+		if (g_patch.pages) {
+			/* Next page */
+			for (page=0; !(g_patch.pages & (1 << page)); page++);
+			g_patch.pages &= ~(1 << page);
+
+			pf_invalidate_range(g_patch.sect + (page << 8), 256);
+			flash_write_enable();
+			flash_page_program(&g_patch.buf[page << 8], g_patch.sect + (page << 8), 256);
+		} else if (g_patch.done < g_patch.len) {
+			/* Next sector */
+			patch_sector_start();
+		} else {
+			/* All done */
+			pf_invalidate();
+			g_patch.result = patch_verify() ? PATCH_OK : PATCH_ERR_VERIFY;
+			g_patch.state  = PATCH_IDLE;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+// Sector CRC map
+// ---------------------------------------------------------------------------
+
+/*
+ * CRC32 (zlib) of each 4k sector of a range, so the host can find out
+ * which sectors differ from its image without reading them back. The
+ * host starts it with a vendor request and then reads the map, which is
+ * computed from the main loop, MAP_CHUNK bytes per iteration.
+ */
+
+#define MAP_MAX		256	/* Sectors per request (1 MiB) */
+#define MAP_CHUNK	256
+
+static struct {
+	uint32_t addr;		/* Next byte to read */
+	unsigned n;		/* Sectors requested */
+	unsigned done;		/* Sectors completed */
+	uint32_t crc;		/* Running CRC of the current sector */
 
-static void
-patch_descriptors(bool bl_upgrade)
+	/* Reply : n, done, then one CRC per sector */
+	uint32_t reply[2 + MAP_MAX];
+} g_map;
+
+static bool
+map_start(struct usb_xfer *xfer)
 {
-	volatile struct usb_conf_desc *conf = (void*)dfu_stack_desc.conf[0];
-	int n = bl_upgrade ? 4 : 2;
+	uint32_t *req = (uint32_t *)&g_map.reply[2];
+	uint32_t addr = req[0];
+	unsigned n = req[1];
+
+	/* Sector aligned and inside the flash, else empty map */
+	if ((addr & 4095) || (n > MAP_MAX) || !flash_range_ok(addr, n << 12))
+		n = 0;
 
-	/* We patch the descriptor length ... in RO section but not really RO */
-	conf->wTotalLength = sizeof( struct usb_conf_desc) + n * (sizeof(struct usb_intf_desc) + sizeof(struct usb_dfu_func_desc));
+	g_map.addr = addr;
+	g_map.n    = n;
+	g_map.done = 0;
+	g_map.crc  = 0;
+
+	return true;
 }
 
 static void
-set_single_led(bool bl_upgrade)
+map_poll(void)
 {
-	/* Set the single led to slow or fast flash */
-	misc_regs->led = (1 << 31) | ((bl_upgrade ? 120 : 600) << 16) | (120 << 0);
+	uint8_t buf[MAP_CHUNK] __attribute__((aligned(4)));
+
+	if (g_map.done >= g_map.n)
+		return;
+
+	/* Not while the flash is busy */
+	if (flash_busy())
+		return;
+
+	flash_read(buf, g_map.addr, MAP_CHUNK);
+	g_map.crc = crc32(g_map.crc, buf, MAP_CHUNK);
+	g_map.addr += MAP_CHUNK;
+
+	if (!(g_map.addr & 4095)) {
+		g_map.reply[2 + g_map.done++] = g_map.crc;
+		g_map.crc = 0;
+	}
 }
 
 
@@ -96,24 +933,44 @@ usb_dfu_cb_reboot(void)
 bool
 usb_dfu_cb_flash_busy(void)
 {
-	return flash_read_sr(1) & 1;
+	bool busy = flash_busy();
+	if (!busy) {
+		g_flash.erasing = false;
+
+		/* Combined image record erases are issued from here */
+		busy = cmb_erase_poll();
+	}
+	return busy;
 }
 
 void
 usb_dfu_cb_flash_erase(uint32_t addr, unsigned size)
 {
-	flash_write_enable();
-
-	switch (size) {
-	case 4096:  flash_sector_erase(addr);
-	case 32678: flash_block_erase_32k(addr);
-	case 65536: flash_block_erase_64k(addr);
+	if (addr >= CMB_BASE) {
+		if (addr == CMB_BASE)
+			cmb_start();
+		return;
 	}
+
+	if ((size == 4096) && erase_ahead_request(addr))
+		return;
+
+	/* The DFU core has no way to fail this, the programming that
+	 * follows will then just not verify */
+	if (!flash_erase(addr, size))
+		printf("[!] No erase for %d bytes @ %08x\n", size, addr);
 }
 
 void
 usb_dfu_cb_flash_program(const void *data, uint32_t addr, unsigned size)
 {
+	if (addr >= CMB_BASE) {
+		cmb_program(data, size);
+		return;
+	}
+
+	pf_invalidate();
+
 	flash_write_enable();
 	flash_page_program(data, addr, size);
 }
@@ -121,7 +978,13 @@ usb_dfu_cb_flash_program(const void *data, uint32_t addr, unsigned size)
 void
 usb_dfu_cb_flash_read(void *data, uint32_t addr, unsigned size)
 {
-	flash_read(data, addr, size);
+	/* Nothing to read back from the combined zone */
+	if (addr >= CMB_BASE) {
+		memset(data, 0xff, size);
+		return;
+	}
+
+	pf_read(data, addr, size);
 }
 
 void
@@ -130,18 +993,730 @@ usb_dfu_cb_flash_raw(void *data, unsigned len)
 	struct spi_xfer_chunk sx[1] = {
 		{ .data = data, .len = len, .read = true, .write = true, },
 	};
+	uint8_t *cmd = data;
+	bool suspended = false;
+	bool poll = false;
+
+	/* Plain reads go through the prefetcher (3 or 4 bytes address) */
+	if ((cmd[0] == 0x03) && (len > 4)) {
+		pf_read(&cmd[4], (cmd[1] << 16) | (cmd[2] << 8) | cmd[3], len - 4);
+		return;
+	}
+
+	if ((cmd[0] == 0x13) && (len > 5)) {
+		pf_read(&cmd[5], ((uint32_t)cmd[1] << 24) | (cmd[2] << 16) | (cmd[3] << 8) | cmd[4], len - 5);
+		return;
+	}
+
+	/* Status polls from the host get the SR1 the busy poller read once the
+	 * flash went idle when there's one, a real read otherwise */
+	if ((cmd[0] == 0x05) && (len == 2)) {
+		cmd[1] = flash_status();
+		return;
+	}
+
+	switch (cmd[0]) {
+	case 0x20: case 0x52: case 0xd8:
+	case 0x21: case 0x5c: case 0xdc:
+		/* Host issued erases must be tracked, and reads served */
+		g_flash.erasing = true;
+		/* fall-through */
+	case 0x60: case 0xc7:
+	case 0x01: case 0x31: case 0x11:
+	case 0x02: case 0x12:
+		/* Erase ahead and prefetch can't be trusted anymore after raw
+		 * writes. Chip erases and status register writes (SR1/2/3, can
+		 * change the protection) also keep the flash busy, but can't
+		 * be suspended : reads wait for them */
+		erase_ahead_reset();
+		pf_invalidate();
+		poll = true;
+		break;
+	case 0x0b: case 0x0c:
+		suspended = flash_erase_suspend();
+		break;
+	}
+
 	spi_xfer(SPI_CS_FLASH, sx, 1);
+
+	if (poll)
+		flash_poll_start();
+
+	if (suspended)
+		flash_erase_resume();
 }
 
 
-static const struct usb_dfu_zone dfu_zones[] = {
-	{ 0x00080000, 0x000a0000 },     /* iCE40 bitstream */
-	{ 0x000a0000, 0x000c0000 },     /* RISC-V firmware */
-	{ 0x00040000, 0x00060000 },     /* Bootloader bitstream */
-	{ 0x00060000, 0x00080000 },     /* Bootloader firmware  */
+// ---------------------------------------------------------------------------
+// UART flashing
+// ---------------------------------------------------------------------------
+
+#ifdef ENABLE_UART
+
+/*
+ * Framed binary protocol on the console UART, all fields little endian :
+ *
+ *   0xa5, u8 type, u8 seq, u16 len, payload[len], u32 CRC32 (type .. payload)
+ *
+ * Responses use `type | 0x80` and the request seq, their payload starts
+ * with a status byte. Frames are processed in order : the host can have
+ * up to UF_WINDOW of them in flight and goes back to the first one not
+ * acknowledged on NAK (bad CRC or out of order seq, the NAK carries the
+ * expected seq) or timeout. Old frames (already acknowledged) are only
+ * executed again if they don't modify the flash.
+ *
+ * CRC covers at most UF_MAX_CRC bytes and takes an optional initial value
+ * (the previous result) so longer ranges are done in several commands.
+ * PROGRAM and ERASE refuse the bootloader area, unless started for a
+ * bootloader upgrade, like the DFU zones.
+ *
+ * INFO always (re)synchronizes the sequence numbers. Bytes outside of
+ * frames are handed to the console until the first valid frame, and
+ * dropped after that (they're most likely from a corrupted frame).
+ *
+ * Incoming bytes are moved to a ring buffer whenever we wait on the flash
+ * so the FIFO of the UART core doesn't overflow during erases.
+ */
+
+#define UF_SOF			0xa5
+#define UF_WINDOW		4
+#define UF_MAX_DATA		256
+#define UF_MAX_PAYLOAD		(UF_MAX_DATA + 8)
+#define UF_MAX_CRC		4096		/* Per CRC command, bounds the time without usb_poll() */
+#define UF_RING_SIZE		2048	/* > UF_WINDOW full frames */
+#define UF_BAUD_TIMEOUT		(24 * 200000)	/* 200 ms */
+#define UF_DEFAULT_DIV		22		/* 1 Mbaud */
+#define UF_MIN_DIV		2		/* 6 Mbaud, the receiver samples at div/2 */
+#define UF_MAX_DIV		4095		/* uart_wb DIV_WIDTH is 12 */
+
+enum uf_cmd {
+	UF_CMD_INFO	= 0x01,
+	UF_CMD_READ	= 0x02,
+	UF_CMD_PROGRAM	= 0x03,
+	UF_CMD_ERASE	= 0x04,
+	UF_CMD_CRC	= 0x05,
+	UF_CMD_BOOT	= 0x06,
+	UF_CMD_BAUD	= 0x07,
+	UF_NAK		= 0x7f,
+};
+
+enum uf_status {
+	UF_OK		= 0,
+	UF_ERR_ARGS	= 1,
+	UF_ERR_CMD	= 2,
+	UF_ERR_SEQ	= 3,
+	UF_ERR_CRC	= 4,
+};
+
+static struct {
+	/* Ring buffer */
+	uint8_t  ring[UF_RING_SIZE];
+	unsigned ring_rd;
+	unsigned ring_wr;
+
+	/* Frame being received */
+	uint8_t  frame[5 + UF_MAX_PAYLOAD + 4];
+	unsigned len;
+
+	/* Sequence */
+	uint8_t  seq;
+	bool     active;
+
+	/* Baud rate change pending confirmation */
+	uint16_t div;
+	uint16_t div_prev;
+	bool     div_check;
+	uint32_t t_div;
+
+	/* Response */
+	uint8_t  resp[1 + UF_MAX_DATA];
+} g_uf = {
+	.div = UF_DEFAULT_DIV,
+};
+
+static inline uint32_t
+uf_get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void
+uf_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void
+uf_rx_drain(void)
+{
+	unsigned nxt;
+	int c;
+
+	while (1) {
+		nxt = (g_uf.ring_wr + 1) & (UF_RING_SIZE - 1);
+		if (nxt == g_uf.ring_rd)
+			break;
+
+		if ((c = getchar_nowait()) < 0)
+			break;
+
+		g_uf.ring[g_uf.ring_wr] = c;
+		g_uf.ring_wr = nxt;
+	}
+}
+
+static void
+uf_flash_wait(void)
+{
+	while (flash_busy())
+		uf_rx_drain();
+	g_flash.erasing = false;
+}
+
+static void
+uf_send(uint8_t type, uint8_t seq, const uint8_t *data, unsigned len)
+{
+	uint8_t hdr[5] = { UF_SOF, type, seq, len, len >> 8 };
+	uint8_t crc[4];
+	unsigned i;
+
+	uf_put32(crc, crc32(crc32(0, &hdr[1], 4), data, len));
+
+	for (i=0; i<5; i++)
+		putchar(hdr[i]);
+	for (i=0; i<len; i++)
+		putchar(data[i]);
+	for (i=0; i<4; i++)
+		putchar(crc[i]);
+}
+
+static void
+uf_nak(enum uf_status st)
+{
+	uint8_t d[2] = { st, g_uf.seq };
+	uf_send(UF_NAK, g_uf.seq, d, 2);
+}
+
+static void
+uf_tx_flush(unsigned div)
+{
+	/* Everything is sent once the TX line stayed idle for longer than a
+	 * byte can hold it high (8 data + stop bits), at div+2 cycles per bit */
+	while (misc_regs->uart_idle < (10 * (div + 2)));
+}
+
+/* Returns the response length (after the status byte), < 0 for errors */
+static int
+uf_exec(uint8_t type, const uint8_t *p, unsigned len, bool replay)
+{
+	uint8_t *r = &g_uf.resp[1];
+	const struct flash_info *fi = flash_get_info();
+	uint32_t addr, l, crc, end;
+	unsigned n;
+
+	/* Already done, only answer */
+	if (replay && ((type == UF_CMD_PROGRAM) || (type == UF_CMD_ERASE) || (type == UF_CMD_BAUD)))
+		return 0;
+
+	switch (type) {
+	case UF_CMD_INFO:
+		/* u8 version, u8 window, u16 max data, u32 flash size, u16 div */
+		r[0] = 1;
+		r[1] = UF_WINDOW;
+		r[2] = UF_MAX_DATA & 0xff;
+		r[3] = UF_MAX_DATA >> 8;
+		uf_put32(&r[4], fi->size);
+		r[8] = g_uf.div & 0xff;
+		r[9] = g_uf.div >> 8;
+		return 10;
+
+	case UF_CMD_READ:
+		/* u32 addr, u16 len */
+		if (len != 6)
+			return -UF_ERR_ARGS;
+		addr = uf_get32(p);
+		l = p[4] | (p[5] << 8);
+		if (l > UF_MAX_DATA)
+			return -UF_ERR_ARGS;
+		uf_flash_wait();
+		pf_read(r, addr, l);
+		return l;
+
+	case UF_CMD_PROGRAM:
+		/* u32 addr, data (within one page) */
+		if ((len < 5) || (len > (4 + UF_MAX_DATA)))
+			return -UF_ERR_ARGS;
+		addr = uf_get32(p);
+		if (((addr & 0xff) + len - 4) > 256)
+			return -UF_ERR_ARGS;
+		if (!g_bl_upgrade && (addr < 0x00080000))
+			return -UF_ERR_ARGS;
+		uf_flash_wait();
+		erase_ahead_reset();
+		pf_invalidate();
+		flash_write_enable();
+		flash_page_program(&p[4], addr, len - 4);
+		uf_flash_wait();
+		return 0;
+
+	case UF_CMD_ERASE:
+		/* u32 addr, u32 len (4k aligned) */
+		if (len != 8)
+			return -UF_ERR_ARGS;
+		addr = uf_get32(p);
+		end  = addr + uf_get32(&p[4]);
+		if ((addr | end) & 0xfff)
+			return -UF_ERR_ARGS;
+		if (!g_bl_upgrade && (addr < 0x00080000))
+			return -UF_ERR_ARGS;
+		uf_flash_wait();
+		erase_ahead_reset();
+		while (addr < end) {
+			addr += flash_erase_largest(addr, end);
+			uf_flash_wait();
+		}
+		return 0;
+
+	case UF_CMD_CRC:
+		/* u32 addr, u32 len [, u32 initial crc] -> u32 crc */
+		if ((len != 8) && (len != 12))
+			return -UF_ERR_ARGS;
+		addr = uf_get32(p);
+		l    = uf_get32(&p[4]);
+		crc  = (len == 12) ? uf_get32(&p[8]) : 0;
+		if (l > UF_MAX_CRC)
+			return -UF_ERR_ARGS;
+		uf_flash_wait();
+		while (l) {
+			n = (l > UF_MAX_DATA) ? UF_MAX_DATA : l;
+			flash_read(r, addr, n);
+			crc = crc32(crc, r, n);
+			addr += n;
+			l    -= n;
+			uf_rx_drain();
+		}
+		uf_put32(r, crc);
+		return 4;
+
+	case UF_CMD_BOOT:
+		return 0;
+
+	case UF_CMD_BAUD:
+		/* u16 div, confirmed by the next valid frame at the new rate */
+		if (len != 2)
+			return -UF_ERR_ARGS;
+		n = p[0] | (p[1] << 8);
+		if ((n < UF_MIN_DIV) || (n > UF_MAX_DIV))
+			return -UF_ERR_ARGS;
+		g_uf.div_prev = g_uf.div;
+		g_uf.div = n;
+		return 0;
+
+	default:
+		return -UF_ERR_CMD;
+	}
+}
+
+static void
+uf_frame(void)
+{
+	uint8_t *f = g_uf.frame;
+	uint8_t type = f[1];
+	uint8_t seq = f[2];
+	unsigned len = f[3] | (f[4] << 8);
+	uint8_t d;
+	int rv;
+
+	/* Check */
+	if (crc32(0, &f[1], 4 + len) != uf_get32(&f[5 + len])) {
+		uf_nak(UF_ERR_CRC);
+		return;
+	}
+
+	/* Any valid frame confirms a new baud rate */
+	g_uf.div_check = false;
+	g_uf.active = true;
+
+	/* Sequence */
+	if (type == UF_CMD_INFO)
+		g_uf.seq = seq;
+
+	d = seq - g_uf.seq;
+
+	if (d && (d < 0x80)) {
+		/* Ahead : something was lost */
+		uf_nak(UF_ERR_SEQ);
+		return;
+	}
+
+	/* Execute */
+	rv = uf_exec(type, &f[5], len, d != 0);
+
+	g_uf.resp[0] = (rv < 0) ? -rv : UF_OK;
+	uf_send(type | 0x80, seq, g_uf.resp, 1 + ((rv < 0) ? 0 : rv));
+
+	if (!d)
+		g_uf.seq++;
+
+	/* Post actions */
+	if ((rv >= 0) && !d) {
+		if (type == UF_CMD_BOOT) {
+			uf_tx_flush(g_uf.div);
+			boot_app();
+		} else if (type == UF_CMD_BAUD) {
+			/* Response still goes out at the previous rate */
+			uf_tx_flush(g_uf.div_prev);
+			console_set_div(g_uf.div);
+			g_uf.div_check = true;
+			g_uf.t_div = timestamp();
+		}
+	}
+}
+
+/* Returns a console character or -1 */
+static int
+uf_poll(void)
+{
+	unsigned len;
+	uint8_t c;
+
+	/* Revert an unconfirmed baud rate change */
+	if (g_uf.div_check && (((timestamp() - g_uf.t_div) & 0x7fffffff) > UF_BAUD_TIMEOUT)) {
+		g_uf.div = g_uf.div_prev;
+		g_uf.div_check = false;
+		g_uf.len = 0;
+		console_set_div(g_uf.div);
+	}
+
+	uf_rx_drain();
+
+	while (g_uf.ring_rd != g_uf.ring_wr)
+	{
+		c = g_uf.ring[g_uf.ring_rd];
+		g_uf.ring_rd = (g_uf.ring_rd + 1) & (UF_RING_SIZE - 1);
+
+		/* Outside of a frame */
+		if (!g_uf.len) {
+			if (c != UF_SOF) {
+				if (g_uf.active)
+					continue;
+				return c;
+			}
+			g_uf.frame[g_uf.len++] = c;
+			continue;
+		}
+
+		g_uf.frame[g_uf.len++] = c;
+
+		/* Header */
+		if (g_uf.len < 5)
+			continue;
+
+		len = g_uf.frame[3] | (g_uf.frame[4] << 8);
+		if (len > UF_MAX_PAYLOAD) {
+			/* Garbage, resync */
+			g_uf.len = 0;
+			uf_nak(UF_ERR_CRC);
+			continue;
+		}
+
+		/* Full frame ? */
+		if (g_uf.len == (5 + len + 4)) {
+			g_uf.len = 0;
+			uf_frame();
+		}
+	}
+
+	return -1;
+}
+
+#endif /* ENABLE_UART */
+
+
+// ---------------------------------------------------------------------------
+// Vendor requests
+// ---------------------------------------------------------------------------
+
+enum fw_vendor_req {
+	FW_VND_REQ_BOOT_TRACE	= 0x10,
+	FW_VND_REQ_ERASE_AHEAD	= 0x11,
+	FW_VND_REQ_CMB_STATUS	= 0x12,
+	FW_VND_REQ_PATCH	= 0x13,
+	FW_VND_REQ_SECTOR_MAP	= 0x14,
+	FW_VND_REQ_SPI_TRACE	= 0x15,
+};
+
+/* DFU class requests we watch */
+#define DFU_REQ_DNLOAD		1
+#define DFU_REQ_ABORT		6
+
+static uint32_t _vnd_buf[9];
+
+/* SPI traffic capture (optional gateware, see rtl/spi_trace.v) */
+struct wb_spi_trace {
+	uint32_t csr;
+	uint32_t wptr;
+	uint32_t time;
+} __attribute__((packed,aligned(4)));
+
+#define SPI_TRACE_CSR_PRESENT	(1 << 31)
+#define SPI_TRACE_CSR_AW(csr)	(((csr) >> 16) & 0xff)
+#define SPI_TRACE_CTRL_MASK	0x7
+#define SPI_TRACE_CHUNK		64	/* Entries per request */
+
+static volatile struct wb_spi_trace * const spi_trace_regs = (void*)(SPI_TRACE_BASE);
+
+static uint32_t _trace_buf[3 + SPI_TRACE_CHUNK];
+
+static unsigned
+spi_trace_read(unsigned ofs, unsigned len)
+{
+	const volatile uint32_t *mem;
+	uint32_t csr = spi_trace_regs->csr;
+	unsigned depth, n, i;
+
+	/* Status, write pointer, capture time */
+	_trace_buf[0] = csr;
+	_trace_buf[1] = spi_trace_regs->wptr;
+	_trace_buf[2] = spi_trace_regs->time;
+
+	if (!(csr & SPI_TRACE_CSR_PRESENT) || (len < 12))
+		return 12;
+
+	/* Then entries from 'ofs', as many as fit */
+	depth = 1 << SPI_TRACE_CSR_AW(csr);
+	mem   = (const volatile uint32_t *)spi_trace_regs + depth;
+
+	n = (len - 12) >> 2;
+	if (n > SPI_TRACE_CHUNK)
+		n = SPI_TRACE_CHUNK;
+	if (ofs >= depth)
+		n = 0;
+	else if (n > depth - ofs)
+		n = depth - ofs;
+
+	for (i=0; i<n; i++)
+		_trace_buf[3+i] = mem[ofs+i];
+
+	return 12 + (n << 2);
+}
+
+static enum usb_fnd_resp
+_fw_ctrl_req(struct usb_ctrl_req *req, struct usb_xfer *xfer)
+{
+	int i;
+
+	/* Any request will do */
+	boot_mark(BOOT_MS_FIRST_SETUP);
+
+	/* End of download (zero length block) or abort : the erase ahead
+	 * hint is used up. Just watching, the DFU driver (registered before
+	 * us, so called after) handles them */
+	if ((USB_REQ_TYPE_RCPT(req) == (USB_REQ_TYPE_CLASS | USB_REQ_RCPT_INTF)) &&
+	    (((req->bRequest == DFU_REQ_DNLOAD) && !req->wLength) || (req->bRequest == DFU_REQ_ABORT)))
+		erase_ahead_hint(0);
+
+	/* Vendor requests to interface 0 only */
+	if (USB_REQ_TYPE_RCPT(req) != (USB_REQ_TYPE_VENDOR | USB_REQ_RCPT_INTF))
+		return USB_FND_CONTINUE;
+
+	if (req->wIndex != 0)
+		return USB_FND_CONTINUE;
+
+	switch (req->bRequest)
+	{
+	case FW_VND_REQ_BOOT_TRACE:
+		if (!USB_REQ_IS_READ(req))
+			return USB_FND_ERROR;
+
+		/* Milestones, then current timestamp */
+		for (i=0; i<8; i++)
+			_vnd_buf[i] = misc_regs->trace_ms[i];
+		_vnd_buf[8] = misc_regs->trace;
+
+		xfer->data = (void*)_vnd_buf;
+		xfer->len  = sizeof(_vnd_buf);
+		return USB_FND_SUCCESS;
+
+	case FW_VND_REQ_ERASE_AHEAD:
+		/* Length of the next download in 4k sectors (0 = no erase ahead) */
+		erase_ahead_hint((uint32_t)req->wValue << 12);
+		return USB_FND_SUCCESS;
+
+	case FW_VND_REQ_CMB_STATUS:
+		if (!USB_REQ_IS_READ(req))
+			return USB_FND_ERROR;
+
+		/* Error, records, bytes left in current record */
+		_vnd_buf[0] = g_cmb.error | (g_cmb.n_rec << 8);
+		_vnd_buf[1] = g_cmb.remain;
+
+		xfer->data = (void*)_vnd_buf;
+		xfer->len  = 8;
+		return USB_FND_SUCCESS;
+
+	case FW_VND_REQ_PATCH:
+		if (USB_REQ_IS_READ(req)) {
+			/* Result, then skipped / programmed only / erased sectors */
+			_vnd_buf[0] = g_patch.result |
+				(g_patch.n_skipped << 8) | (g_patch.n_programmed << 16) | (g_patch.n_erased << 24);
+
+			xfer->data = (void*)_vnd_buf;
+			xfer->len  = 4;
+			return USB_FND_SUCCESS;
+		}
+
+		/* Address and at least one byte, one patch at a time */
+		if ((g_patch.state != PATCH_IDLE) || (req->wLength <= 4) || (req->wLength > sizeof(g_patch.req)))
+			return USB_FND_ERROR;
+
+		xfer->data    = g_patch.req;
+		xfer->len     = req->wLength;
+		xfer->cb_done = patch_start;
+		return USB_FND_SUCCESS;
+
+	case FW_VND_REQ_SECTOR_MAP:
+		if (USB_REQ_IS_READ(req)) {
+			/* Sectors requested, completed, then the CRCs so far */
+			g_map.reply[0] = g_map.n;
+			g_map.reply[1] = g_map.done;
+
+			xfer->data = (void*)g_map.reply;
+			xfer->len  = 8 + 4 * g_map.done;
+			return USB_FND_SUCCESS;
+		}
+
+		/* Start address and sector count */
+		if (req->wLength != 8)
+			return USB_FND_ERROR;
+
+		xfer->data    = (void*)&g_map.reply[2];
+		xfer->len     = 8;
+		xfer->cb_done = map_start;
+		return USB_FND_SUCCESS;
+
+	case FW_VND_REQ_SPI_TRACE:
+		if (USB_REQ_IS_READ(req)) {
+			/* Header, then entries from wValue */
+			xfer->data = (void*)_trace_buf;
+			xfer->len  = spi_trace_read(req->wValue, req->wLength);
+			return USB_FND_SUCCESS;
+		}
+
+		/* One-shot / Enable / Clear. No effect without the gateware */
+		spi_trace_regs->csr = req->wValue & SPI_TRACE_CTRL_MASK;
+		return USB_FND_SUCCESS;
+
+	default:
+		return USB_FND_CONTINUE;
+	}
+}
+
+static struct usb_fn_drv _fw_drv = {
+	.ctrl_req = _fw_ctrl_req,
 };
 
 
+// ---------------------------------------------------------------------------
+// Memory ops benchmark
+// ---------------------------------------------------------------------------
+
+#ifdef MEMOPS_BENCH
+/*
+ * Cycle counts of memcpy / memset / memcmp (memops.S) against plain byte
+ * loops, equivalent to the newlib-nano ones they replace. Printed as
+ * BENCH lines on the console, see gateware/ice40 `make bench`.
+ */
+
+#define MB_LEN		256
+#define MB_REPEAT	8
+
+static uint32_t mb_buf[2][MB_LEN / 4 + 1];
+
+static void * __attribute__((noinline,optimize("no-tree-loop-distribute-patterns")))
+mb_ref_memcpy(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	while (n--)
+		*d++ = *s++;
+	return dst;
+}
+
+static void * __attribute__((noinline,optimize("no-tree-loop-distribute-patterns")))
+mb_ref_memset(void *dst, int c, size_t n)
+{
+	uint8_t *d = dst;
+	while (n--)
+		*d++ = c;
+	return dst;
+}
+
+static int __attribute__((noinline))
+mb_ref_memcmp(const void *a, const void *b, size_t n)
+{
+	const uint8_t *x = a, *y = b;
+	for (; n; n--, x++, y++)
+		if (*x != *y)
+			return *x - *y;
+	return 0;
+}
+
+/* Called through volatile pointers so nothing gets inlined / elided */
+static void * (* volatile mb_cpy[2])(void *, const void *, size_t) = { mb_ref_memcpy, memcpy };
+static void * (* volatile mb_set[2])(void *, int, size_t) = { mb_ref_memset, memset };
+static int    (* volatile mb_cmp[2])(const void *, const void *, size_t) = { mb_ref_memcmp, memcmp };
+
+static void
+mb_report(const char *name, unsigned len, uint32_t t[2])
+{
+	printf("memops: %s %d bytes : %d cycles (byte loop %d)\n", name, len, t[1], t[0]);
+	printf("BENCH memops.%s_%d_cyc %d lower\n", name, len, t[1]);
+}
+
+static void
+memops_bench(void)
+{
+	uint8_t *s = (uint8_t *)mb_buf[0];
+	uint8_t *d = (uint8_t *)mb_buf[1];
+	uint32_t t[2];
+	int i, r;
+
+	for (i=0; i<MB_LEN; i++)
+		s[i] = i;
+
+#define MB_RUN(expr) \
+	for (i=0; i<2; i++) { \
+		t[i] = timestamp(); \
+		for (r=0; r<MB_REPEAT; r++) \
+			expr; \
+		t[i] = ((timestamp() - t[i]) & 0x7fffffff) / MB_REPEAT; \
+	}
+
+	MB_RUN(mb_cpy[i](d, s, MB_LEN))
+	mb_report("memcpy", MB_LEN, t);
+
+	MB_RUN(mb_cpy[i](d, s, 64))
+	mb_report("memcpy", 64, t);
+
+	MB_RUN(mb_cpy[i](d, s + 1, MB_LEN))
+	mb_report("memcpy_unaligned", MB_LEN, t);
+
+	MB_RUN(mb_set[i](d, 0xff, MB_LEN))
+	mb_report("memset", MB_LEN, t);
+
+	mb_cpy[1](d, s, MB_LEN);
+	MB_RUN(mb_cmp[i](d, s, MB_LEN))
+	mb_report("memcmp", MB_LEN, t);
+
+#undef MB_RUN
+}
+#endif
+
+
 // ---------------------------------------------------------------------------
 // Main
 // ---------------------------------------------------------------------------
@@ -151,6 +1726,18 @@ void main()
 	bool bl_upgrade = false;
 	int cmd = 0;
 
+	boot_mark(BOOT_MS_MAIN);
+
+	/*
+	 * Connect to the bus as early as possible so the host debounce delay
+	 * overlaps with our init. Nothing gets answered before the first
+	 * usb_poll() so descriptors / serial can still be patched below.
+	 */
+	usb_init(&dfu_stack_desc);
+	usb_connect();
+
+	boot_mark(BOOT_MS_USB_CONNECT);
+
 	/* Init console IO */
 	console_init();
 	puts("Booting DFU image..\n");
@@ -164,9 +1751,14 @@ void main()
 
 	/* SPI */
 	spi_init();
+	flash_discover();
+	flash_suspend_init();
+	pf_invalidate();
+	zones_init();
 
 	/* Should be allow boot loader upgrad ? */
 	bl_upgrade = ((flash_read_sr(1) & 0x7c) == 0);
+	g_bl_upgrade = bl_upgrade;
 
 	if (bl_upgrade)
 		led_color(64, 0, 16);
@@ -175,13 +1767,35 @@ void main()
 
 	set_single_led(bl_upgrade);
 	patch_descriptors(bl_upgrade);
-
-	/* Enable USB directly */
 	serial_no_init();
-	usb_init(&dfu_stack_desc);
-	usb_dfu_init(dfu_zones, 4);
+
+	/* Finish USB stack setup */
+	usb_dfu_init(dfu_zones, num_elem(dfu_zones));
 	usb_msos20_init(NULL);
-	usb_connect();
+	usb_register_function_driver(&_fw_drv);
+
+	boot_mark(BOOT_MS_INIT_DONE);
+
+	/* Debug info */
+	{
+		uint8_t buf[8];
+
+		flash_manuf_id(buf);
+		printf("Flash Manufacturer : %s\n", hexstr(buf, 3, true));
+
+		flash_unique_id(buf);
+		printf("Flash Unique ID    : %s\n", hexstr(buf, 8, true));
+
+		printf("Flash SR1 %02x / SR2 %02x\n", flash_read_sr(1), flash_read_sr(2));
+
+		const struct flash_info *fi = flash_get_info();
+		printf("Flash %d kB, read %02x, br %d, %d erase sizes\n",
+			fi->size >> 10, fi->read_op, fi->spi_br, fi->n_erase);
+	}
+
+#ifdef MEMOPS_BENCH
+	memops_bench();
+#endif
 
 	/* Main loop */
 	while (1)
@@ -190,8 +1804,12 @@ void main()
 		if (cmd >= 0)
 			printf("Command> ");
 
-		/* Poll for command */
+		/* Poll for command (and UART flashing frames) */
+#ifdef ENABLE_UART
+		cmd = uf_poll();
+#else
 		cmd = getchar_nowait();
+#endif
 
 		if (cmd >= 0) {
 			if (cmd > 32 && cmd < 127) {
@@ -212,5 +1830,11 @@ void main()
 
 		/* USB poll */
 		usb_poll();
+
+		/* Background erase / read prefetch / patch / CRC map */
+		erase_ahead_poll();
+		pf_poll();
+		patch_poll();
+		map_poll();
 	}
 }
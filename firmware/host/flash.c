@@ -0,0 +1,314 @@
+/*
+ * flash.c
+ *
+ * SPI NOR flash model for the host build
+ *
+ * Behaves like a W25Q128 as far as the firmware can tell : JEDEC / unique
+ * ID, SFDP (just the BFPT, can be disabled), status registers (writes only
+ * take time, the values aren't kept), 3 and 4 byte address read / program /
+ * erase opcodes and erase suspend / resume.
+ * Operation times are typical datasheet values and are accounted in virtual
+ * time.
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+
+#define T_PROGRAM	( 700 * HOST_TICKS_PER_US)
+#define T_ERASE_4K	( 45000 * HOST_TICKS_PER_US)
+#define T_ERASE_32K	(120000 * HOST_TICKS_PER_US)
+#define T_ERASE_64K	(150000 * HOST_TICKS_PER_US)
+#define T_WRITE_SR	( 10000 * HOST_TICKS_PER_US)
+
+#define SR1_BUSY	(1 << 0)
+#define SR1_WEL		(1 << 1)
+#define SR2_SUS		(1 << 7)
+
+
+static const uint8_t flash_jedec[3] = { 0xef, 0x40, 0x18 };
+static const uint8_t flash_uid[8]   = { 0xd1, 0x64, 0x38, 0x03, 0x13, 0x2f, 0x57, 0x26 };
+
+/* Header, one parameter header and the JESD216 rev 0 BFPT (9 dwords) at 0x80 */
+static const uint32_t flash_sfdp[] = {
+	[0x00 >> 2] = 0x50444653,	/* 'SFDP' */
+	[0x04 >> 2] = 0xff000100,	/* Rev 1.0, 1 parameter header */
+	[0x08 >> 2] = 0x09010000,	/* BFPT, rev 1.0, 9 dwords */
+	[0x0c >> 2] = 0xff000080,	/* @ 0x80 */
+	[0x80 >> 2] = 0xfff120e5,	/* 4k erase 20h, 3 byte addresses only */
+	[0x84 >> 2] = 0x07ffffff,	/* 128 Mbits */
+	[0x88 >> 2] = 0x6b08eb44,
+	[0x8c >> 2] = 0xbb423b08,
+	[0x90 >> 2] = 0xffffffee,
+	[0x94 >> 2] = 0xff00ffff,
+	[0x98 >> 2] = 0xeb44ffff,
+	[0x9c >> 2] = 0x520f200c,	/* 4k 20h, 32k 52h */
+	[0xa0 >> 2] = 0x0000d810,	/* 64k d8h */
+};
+
+
+static struct {
+	uint8_t *mem;
+	uint32_t size;
+	bool sfdp;
+
+	/* Status */
+	bool wel;
+	bool suspended;
+	uint64_t busy_until;
+	uint64_t busy_left;	/* Saved while suspended */
+
+	/* Current command */
+	bool active;
+	unsigned n;		/* Bytes since CS went low */
+	uint8_t op;
+	uint32_t addr;
+	unsigned addr_len;
+	unsigned dummy;
+
+	/* Page program buffer, applied at CS high */
+	uint8_t page[256];
+	bool page_used[256];
+} g_flash;
+
+
+static bool
+flash_busy(void)
+{
+	return g_ticks < g_flash.busy_until;
+}
+
+static void
+flash_set_busy(uint64_t t)
+{
+	g_flash.busy_until = g_ticks + t;
+	g_flash.wel = false;
+}
+
+static unsigned
+flash_op_addr_len(uint8_t op)
+{
+	switch (op) {
+	case 0x03: case 0x0b: case 0x02: case 0x5a:
+	case 0x20: case 0x52: case 0xd8:
+		return 3;
+	case 0x13: case 0x0c: case 0x12:
+	case 0x21: case 0x5c: case 0xdc:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static unsigned
+flash_op_dummy(uint8_t op)
+{
+	switch (op) {
+	case 0x0b: case 0x0c: case 0x5a:
+		return 1;
+	case 0x4b:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static void
+flash_erase_apply(uint32_t size, uint64_t t)
+{
+	if (!g_flash.wel || g_flash.suspended)
+		return;
+
+	memset(&g_flash.mem[(g_flash.addr & ~(size - 1)) % g_flash.size], 0xff, size);
+	flash_set_busy(t);
+}
+
+static void
+flash_cmd_start(void)
+{
+	/* Opcodes without address */
+	switch (g_flash.op) {
+	case 0x06:
+		g_flash.wel = true;
+		break;
+	case 0x04:
+		g_flash.wel = false;
+		break;
+	case 0x75:
+		if (flash_busy() && !g_flash.suspended) {
+			g_flash.busy_left  = g_flash.busy_until - g_ticks;
+			g_flash.busy_until = g_ticks;
+			g_flash.suspended  = true;
+		}
+		break;
+	case 0x7a:
+		if (g_flash.suspended) {
+			g_flash.busy_until = g_ticks + g_flash.busy_left;
+			g_flash.suspended  = false;
+		}
+		break;
+	}
+}
+
+static void
+flash_cmd_addr(void)
+{
+	switch (g_flash.op) {
+	case 0x20: case 0x21:
+		flash_erase_apply(4096, T_ERASE_4K);
+		break;
+	case 0x52: case 0x5c:
+		flash_erase_apply(32768, T_ERASE_32K);
+		break;
+	case 0xd8: case 0xdc:
+		flash_erase_apply(65536, T_ERASE_64K);
+		break;
+	case 0x02: case 0x12:
+		memset(g_flash.page_used, 0x00, sizeof(g_flash.page_used));
+		break;
+	}
+}
+
+static void
+flash_cmd_end(void)
+{
+	uint32_t base;
+	int i;
+
+	if (!g_flash.wel || g_flash.suspended)
+		return;
+
+	/* Status register writes, at least one data byte */
+	if ((g_flash.op == 0x01) || (g_flash.op == 0x31) || (g_flash.op == 0x11)) {
+		if (g_flash.n > 1)
+			flash_set_busy(T_WRITE_SR);
+		return;
+	}
+
+	if ((g_flash.op != 0x02) && (g_flash.op != 0x12))
+		return;
+
+	/* NOR : can only clear bits */
+	base = (g_flash.addr & ~0xff) % g_flash.size;
+
+	for (i=0; i<256; i++)
+		if (g_flash.page_used[i])
+			g_flash.mem[base + i] &= g_flash.page[i];
+
+	flash_set_busy(T_PROGRAM);
+}
+
+void
+flash_model_cs(bool active)
+{
+	if (!active && g_flash.active && g_flash.n)
+		flash_cmd_end();
+
+	g_flash.active = active;
+	g_flash.n = 0;
+}
+
+uint8_t
+flash_model_xfer(uint8_t mosi)
+{
+	unsigned n = g_flash.n++;
+	unsigned d;
+
+	/* Opcode */
+	if (n == 0) {
+		g_flash.op = mosi;
+		g_flash.addr = 0;
+		g_flash.addr_len = flash_op_addr_len(mosi);
+		g_flash.dummy = flash_op_dummy(mosi);
+
+		g_stats.flash_cmds[mosi]++;
+
+		/* While busy, only status and suspend are accepted */
+		if (flash_busy() && (mosi != 0x05) && (mosi != 0x35) && (mosi != 0x75)) {
+			fprintf(stderr, "[!] Flash command %02x while busy\n", mosi);
+			g_flash.op = 0xff;
+			g_flash.addr_len = g_flash.dummy = 0;
+			return 0xff;
+		}
+
+		if (!g_flash.addr_len)
+			flash_cmd_start();
+
+		return 0xff;
+	}
+
+	/* Address */
+	if (n <= g_flash.addr_len) {
+		g_flash.addr = (g_flash.addr << 8) | mosi;
+		if (n == g_flash.addr_len)
+			flash_cmd_addr();
+		return 0xff;
+	}
+
+	/* Dummy */
+	d = n - 1 - g_flash.addr_len;
+
+	if (d < g_flash.dummy)
+		return 0xff;
+
+	d -= g_flash.dummy;
+
+	/* Data */
+	switch (g_flash.op) {
+	case 0x05:
+		return (flash_busy() ? SR1_BUSY : 0) | (g_flash.wel ? SR1_WEL : 0);
+
+	case 0x35:
+		return g_flash.suspended ? SR2_SUS : 0;
+
+	case 0x9f:
+		return (d < 3) ? flash_jedec[d] : 0xff;
+
+	case 0x4b:
+		return (d < 8) ? flash_uid[d] : 0xff;
+
+	case 0x5a:
+		d += g_flash.addr;
+		return (g_flash.sfdp && (d < sizeof(flash_sfdp))) ? (flash_sfdp[d >> 2] >> ((d & 3) << 3)) & 0xff : 0xff;
+
+	case 0x03: case 0x0b: case 0x13: case 0x0c:
+		return g_flash.mem[(g_flash.addr + d) % g_flash.size];
+
+	case 0x02: case 0x12:
+		/* Wraps within the page */
+		d = (g_flash.addr + d) & 0xff;
+		g_flash.page[d] = g_flash.page_used[d] ? (g_flash.page[d] & mosi) : mosi;
+		g_flash.page_used[d] = true;
+		return 0xff;
+
+	default:
+		return 0xff;
+	}
+}
+
+void
+flash_model_init(uint32_t size, bool sfdp)
+{
+	g_flash.mem = malloc(size);
+	g_flash.size = size;
+	g_flash.sfdp = sfdp;
+
+	if (!g_flash.mem) {
+		fprintf(stderr, "Unable to allocate flash model\n");
+		exit(1);
+	}
+
+	memset(g_flash.mem, 0xff, size);
+}
+
+uint8_t *
+flash_model_mem(void)
+{
+	return g_flash.mem;
+}
@@ -0,0 +1,106 @@
+/*
+ * host.c
+ *
+ * Host build setup and reporting
+ *
+ * The firmware main() is the program entry point as-is. Everything the
+ * models need is set up before it runs, from a constructor.
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "host.h"
+
+
+#define FLASH_SIZE	(16 * 1024 * 1024)
+
+
+/*
+ * The firmware patches some of its const data (USB descriptors), which
+ * is fine in SPRAM but not in a read-only segment.
+ */
+static int
+host_phdr_cb(struct dl_phdr_info *info, size_t size, void *data)
+{
+	long pgsz = 4096;
+	int i;
+
+	/* Main executable only (first one) */
+	for (i=0; i<info->dlpi_phnum; i++) {
+		const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+		uintptr_t s, e;
+
+		if ((ph->p_type != PT_LOAD) && (ph->p_type != PT_GNU_RELRO))
+			continue;
+		if (ph->p_flags & PF_X)
+			continue;
+
+		s = (info->dlpi_addr + ph->p_vaddr) & ~(pgsz - 1);
+		e = (info->dlpi_addr + ph->p_vaddr + ph->p_memsz + pgsz - 1) & ~(pgsz - 1);
+
+		mprotect((void *)s, e - s, PROT_READ | PROT_WRITE);
+	}
+
+	return 1;
+}
+
+static void __attribute__((constructor))
+host_init(void)
+{
+	dl_iterate_phdr(host_phdr_cb, NULL);
+
+	/* HOST_NO_SFDP=1 : flash without SFDP, the firmware keeps its defaults */
+	flash_model_init(FLASH_SIZE, !getenv("HOST_NO_SFDP"));
+	mmio_init();
+}
+
+
+void
+host_stats_reset(void)
+{
+	memset(&g_stats, 0x00, sizeof(g_stats));
+}
+
+void
+host_report(const char *op, uint64_t ticks, unsigned bytes)
+{
+	uint64_t rd = 0, wr = 0;
+	int i;
+
+	for (i=0; i<HOST_SLOTS; i++) {
+		rd += g_stats.mmio_rd[i];
+		wr += g_stats.mmio_wr[i];
+	}
+
+	/* Same format as the gateware benches, see utils/bench.py. The _ops
+	 * ones count SPI core register accesses, not SPI transfers */
+	fprintf(stdout, "BENCH host.%s_us %llu lower\n", op,
+		(unsigned long long)(ticks / HOST_TICKS_PER_US));
+	fprintf(stdout, "BENCH host.%s_spi_rd_ops %llu lower\n", op,
+		(unsigned long long)g_stats.mmio_rd[2]);
+	fprintf(stdout, "BENCH host.%s_spi_wr_ops %llu lower\n", op,
+		(unsigned long long)g_stats.mmio_wr[2]);
+	fprintf(stdout, "BENCH host.%s_spi_bytes %llu lower\n", op,
+		(unsigned long long)g_stats.spi_bytes);
+
+	fprintf(stderr, "%-10s %7u bytes %9.3f ms | bus rd %8llu wr %8llu | spi %8llu bytes (%llu words, %llu busy polls) | %llu usb polls\n",
+		op, bytes, ticks / (HOST_TICKS_PER_US * 1000.0),
+		(unsigned long long)rd, (unsigned long long)wr,
+		(unsigned long long)g_stats.spi_bytes, (unsigned long long)g_stats.spi_words,
+		(unsigned long long)g_stats.spi_polls, (unsigned long long)g_stats.usb_polls);
+
+	fprintf(stderr, "%-10s flash cmds :", "");
+	for (i=0; i<256; i++)
+		if (g_stats.flash_cmds[i])
+			fprintf(stderr, " %02x:%llu", i, (unsigned long long)g_stats.flash_cmds[i]);
+	fprintf(stderr, "\n");
+}
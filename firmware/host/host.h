@@ -0,0 +1,52 @@
+/*
+ * host.h
+ *
+ * Host (x86-64 Linux) build of the firmware against software models of
+ * the SoC registers, the SPI flash and the USB stack.
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/* Virtual time, in 24 MHz ticks (same as the boot trace timestamp) */
+#define HOST_TICKS_PER_US	24
+
+extern uint64_t g_ticks;
+
+
+/* Counters, reset for each benchmarked operation */
+#define HOST_SLOTS	7	/* Wishbone slots at 0x80000000 + (n << 24) */
+
+struct host_stats {
+	uint64_t mmio_rd[HOST_SLOTS];
+	uint64_t mmio_wr[HOST_SLOTS];
+	uint64_t spi_bytes;		/* Total SPI bytes, shim words included */
+	uint64_t spi_words;		/* Words pushed through the stream shim */
+	uint64_t spi_polls;		/* Status reads by the busy poller */
+	uint64_t flash_cmds[256];	/* Per opcode */
+	uint64_t usb_polls;
+};
+
+extern struct host_stats g_stats;
+
+
+/* MMIO */
+void mmio_init(void);
+
+
+/* Flash model */
+void     flash_model_init(uint32_t size, bool sfdp);
+void     flash_model_cs(bool active);
+uint8_t  flash_model_xfer(uint8_t mosi);
+uint8_t *flash_model_mem(void);
+
+
+/* Reporting */
+void host_stats_reset(void);
+void host_report(const char *op, uint64_t ticks, unsigned bytes);
@@ -0,0 +1,299 @@
+/*
+ * mmio.c
+ *
+ * Register models for the host build
+ *
+ * The firmware accesses the hardware through plain volatile pointers to
+ * the addresses in config.h. Those are mapped here without any access
+ * rights : each access faults, the handler runs the model (and fills in
+ * the value for reads), makes the page accessible and single steps the
+ * instruction. The trap that follows picks up the value for writes and
+ * protects the page again.
+ *
+ * Only what the flash path needs is modeled : the boot trace timestamp,
+ * SB_SPI (master, manual CS) with the word stream shim and busy poller in
+ * front of it. Everything else reads as 0 and ignores writes.
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define _GNU_SOURCE
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include "config.h"
+#include "host.h"
+
+#ifndef __x86_64__
+# error "MMIO trapping is only implemented for x86-64"
+#endif
+
+
+#define MMIO_BASE	MISC_BASE
+#define SLOT_SIZE	0x10000
+#define EFLAGS_TF	0x100
+
+#define WB_TICKS	4	/* Cost of one bus access, in CPU cycles */
+
+#define SPI_SR_TRDY	(1 << 4)
+#define SPI_SR_RRDY	(1 << 3)
+
+#define SPI_POLL_RUN	(1 << 31)
+#define SPI_POLL_DONE	(1 << 8)
+
+
+uint64_t g_ticks;
+struct host_stats g_stats;
+
+
+// ---------------------------------------------------------------------------
+// SPI
+// ---------------------------------------------------------------------------
+
+static struct {
+	uint32_t regs[16];
+	bool rrdy;
+
+	/* Busy poller */
+	bool p_run;
+	bool p_done;
+	uint8_t p_sr;
+	uint32_t p_ival;
+	uint64_t p_next;
+} g_spi;
+
+static uint8_t
+spi_byte(uint8_t tx)
+{
+	/* CS0 is the flash, active low */
+	uint8_t rx = (g_spi.regs[0xf] & 1) ? 0xff : flash_model_xfer(tx);
+
+	/* SCK = 24 MHz / (BR + 1), TLEAD / TTRAIL / TIDLE not modeled */
+	g_ticks += 8 * ((g_spi.regs[0xb] & 0x3f) + 1);
+	g_stats.spi_bytes++;
+
+	return rx;
+}
+
+/* Runs the polls that happened by now, in parallel with the CPU */
+static void
+spi_poll_catchup(void)
+{
+	uint64_t now = g_ticks;
+	unsigned t_poll = 16 * ((g_spi.regs[0xb] & 0x3f) + 1) + 8;
+
+	while (g_spi.p_run && (g_spi.p_next <= now)) {
+		g_ticks = g_spi.p_next;
+
+		flash_model_cs(true);
+		flash_model_xfer(0x05);
+		g_spi.p_sr = flash_model_xfer(0x00);
+		flash_model_cs(false);
+
+		g_stats.spi_bytes += 2;
+		g_stats.spi_polls++;
+
+		if (g_spi.p_sr & 1) {
+			g_spi.p_next += t_poll + g_spi.p_ival;
+		} else {
+			g_spi.p_run  = false;
+			g_spi.p_done = true;
+		}
+	}
+
+	g_ticks = now;
+}
+
+/* Any access but a status read stops it */
+static void
+spi_poll_access(uint32_t reg, bool write)
+{
+	spi_poll_catchup();
+
+	if (!write && (reg == 0x11))
+		return;
+
+	g_spi.p_run  = false;
+	g_spi.p_done = false;
+}
+
+static uint32_t
+spi_read(uint32_t reg, bool peek)
+{
+	if (!peek)
+		spi_poll_access(reg, false);
+
+	switch (reg) {
+	case 0x0c:
+		return SPI_SR_TRDY | (g_spi.rrdy ? SPI_SR_RRDY : 0);
+	case 0x0e:
+		if (!peek)
+			g_spi.rrdy = false;
+		return g_spi.regs[0xe];
+	case 0x10:
+		/* Stream shim : everything's always sent by now */
+		return 0;
+	case 0x11:
+		return (g_spi.p_run ? SPI_POLL_RUN : 0) | (g_spi.p_done ? SPI_POLL_DONE : 0) | g_spi.p_sr;
+	default:
+		return (reg < 16) ? g_spi.regs[reg] : 0;
+	}
+}
+
+static void
+spi_write(uint32_t reg, uint32_t v)
+{
+	int i;
+
+	spi_poll_access(reg, true);
+
+	switch (reg) {
+	case 0x0d:
+		g_spi.regs[0xe] = spi_byte(v);
+		g_spi.rrdy = true;
+		break;
+	case 0x0f:
+		if ((g_spi.regs[0xf] ^ v) & 1)
+			flash_model_cs(!(v & 1));
+		g_spi.regs[0xf] = v;
+		break;
+	case 0x10:
+		/* Stream shim : 4 bytes, LSB first, RX discarded */
+		for (i=0; i<4; i++, v>>=8)
+			spi_byte(v & 0xff);
+		g_stats.spi_words++;
+		break;
+	case 0x11:
+		/* Busy poller, first status read right away */
+		if (v & SPI_POLL_RUN) {
+			g_spi.p_run  = true;
+			g_spi.p_ival = v & 0xffff;
+			g_spi.p_next = g_ticks;
+		}
+		break;
+	default:
+		if (reg < 16)
+			g_spi.regs[reg] = v;
+		break;
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+// Bus
+// ---------------------------------------------------------------------------
+
+static uint32_t
+bus_read(unsigned slot, uint32_t ofs, bool peek)
+{
+	switch (slot) {
+	case 0:
+		/* Boot trace timestamp */
+		return (ofs == 0x08) ? (g_ticks & 0x7fffffff) : 0;
+	case 2:
+		return spi_read(ofs >> 2, peek);
+	default:
+		return 0;
+	}
+}
+
+static void
+bus_write(unsigned slot, uint32_t ofs, uint32_t v)
+{
+	switch (slot) {
+	case 2:
+		spi_write(ofs >> 2, v);
+		break;
+	default:
+		break;
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+// Trapping
+// ---------------------------------------------------------------------------
+
+static struct {
+	volatile uint32_t *ptr;
+	unsigned slot;
+	uint32_t ofs;
+	bool write;
+} g_pending;
+
+static void
+segv_handler(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	uintptr_t a = (uintptr_t)si->si_addr;
+	unsigned slot = (a - MMIO_BASE) >> 24;
+
+	/* Not ours, let it crash */
+	if ((a < MMIO_BASE) || (slot >= HOST_SLOTS) || ((a & 0xffffff) >= SLOT_SIZE)) {
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	g_pending.ptr   = (volatile uint32_t *)(a & ~3);
+	g_pending.slot  = slot;
+	g_pending.ofs   = a & 0xfffffc;
+	g_pending.write = !!(uc->uc_mcontext.gregs[REG_ERR] & 2);
+
+	mprotect((void *)(a & ~0xfff), 4096, PROT_READ | PROT_WRITE);
+
+	/* Reads get the model value. Writes get it too (without side
+	 * effects) in case the instruction is a read-modify-write */
+	*g_pending.ptr = bus_read(slot, g_pending.ofs, g_pending.write);
+
+	if (g_pending.write)
+		g_stats.mmio_wr[slot]++;
+	else
+		g_stats.mmio_rd[slot]++;
+
+	g_ticks += WB_TICKS;
+
+	uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+}
+
+static void
+trap_handler(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+
+	if (g_pending.write)
+		bus_write(g_pending.slot, g_pending.ofs, *g_pending.ptr);
+
+	mprotect((void *)((uintptr_t)g_pending.ptr & ~0xfff), 4096, PROT_NONE);
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TF;
+}
+
+void
+mmio_init(void)
+{
+	struct sigaction sa;
+	int i;
+
+	for (i=0; i<HOST_SLOTS; i++) {
+		void *p = (void *)(uintptr_t)(MMIO_BASE + (i << 24));
+		if (mmap(p, SLOT_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != p) {
+			fprintf(stderr, "Unable to map MMIO slot %d at %p\n", i, p);
+			exit(1);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+
+	sa.sa_sigaction = segv_handler;
+	sigaction(SIGSEGV, &sa, NULL);
+
+	sa.sa_sigaction = trap_handler;
+	sigaction(SIGTRAP, &sa, NULL);
+}
@@ -0,0 +1,543 @@
+/*
+ * usb.c
+ *
+ * USB stack stand-in for the host build
+ *
+ * Replaces no2usb : the setup calls just record what the firmware
+ * registers, and usb_poll() plays the part of a host running a fixed set
+ * of operations through the same callbacks the real stack would use :
+ *
+ *  - DFU download : the length hint, then each DFU_XFER_SIZE block is
+ *    received and every page is programmed, with a 4k erase request at
+ *    each sector start and a busy wait before each operation, like the
+ *    no2usb DFU core. It ends with a zero length block and checks that
+ *    the rest of the zone wasn't touched.
+ *  - DFU upload : one read callback per block.
+ *  - Raw SPI reads : the read commands of the 'spi exec' vendor request.
+ *  - Sector CRC map : through the firmware vendor request handler.
+ *  - Patch : an unaligned write right after the downloaded data, through
+ *    the vendor request handler too.
+ *  - Raw status register write : write enable and WRSR through the 'spi
+ *    exec' path, then a read of the downloaded data while the write is
+ *    still in progress.
+ *
+ * Transfers take virtual time (per transfer latency and per byte), during
+ * which the firmware main loop keeps running. Each operation gets a report
+ * of its duration and bus / SPI activity and the program exits once they
+ * all ran, with an error status if any data didn't match.
+ *
+ * Copyright (C) 2026 agent
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <no2usb/usb.h>
+#include <no2usb/usb_dfu.h>
+#include <no2usb/usb_msos20.h>
+
+#include "utils.h"
+#include "host.h"
+
+
+#define DFU_XFER_SIZE	4096	/* wTransferSize, see usb_desc_dfu.c */
+
+#define USB_POLL_TICKS	48				/* usb_poll() with nothing to do */
+#define USB_XFER_TICKS	(1000 * HOST_TICKS_PER_US)	/* Control transfer latency */
+#define USB_BYTE_TICKS	24				/* ~1 MB/s of payload */
+
+#define DL_ZONE		1
+#define DL_SIZE		(100 * 1024)	/* Not a multiple of the erase sizes */
+#define RAW_SIZE	(16 * 1024)
+#define RAW_CHUNK	256
+#define MAP_SECTORS	(DL_SIZE / 4096)
+#define PATCH_OFS	(DL_SIZE + 0x123)	/* Unaligned, in the 0x5a fill */
+#define PATCH_LEN	200
+
+
+static struct {
+	const struct usb_dfu_zone *zones;
+	int n_zones;
+	struct usb_fn_drv *drv;
+} g_usb;
+
+
+// ---------------------------------------------------------------------------
+// Stack API
+// ---------------------------------------------------------------------------
+
+void
+usb_init(const struct usb_stack_descriptors *stack_desc)
+{
+}
+
+void
+usb_connect(void)
+{
+}
+
+void
+usb_disconnect(void)
+{
+}
+
+void
+usb_register_function_driver(struct usb_fn_drv *drv)
+{
+	g_usb.drv = drv;
+}
+
+void
+usb_dfu_init(const struct usb_dfu_zone *zones, int n_zones)
+{
+	g_usb.zones = zones;
+	g_usb.n_zones = n_zones;
+}
+
+/* Descriptors are never requested, only needs to exist */
+const struct usb_bos_desc msos20_winusb_bos;
+
+void
+usb_msos20_init(const void *sets)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// Operations
+// ---------------------------------------------------------------------------
+
+enum host_op {
+	OP_DOWNLOAD = 0,
+	OP_UPLOAD,
+	OP_RAW_READ,
+	OP_SECTOR_MAP,
+	OP_PATCH,
+	OP_RAW_WRSR,
+	OP_DONE,
+};
+
+static const char *op_names[] = {
+	[OP_DOWNLOAD]   = "download",
+	[OP_UPLOAD]     = "upload",
+	[OP_RAW_READ]   = "raw_read",
+	[OP_SECTOR_MAP] = "sector_map",
+	[OP_PATCH]      = "patch",
+	[OP_RAW_WRSR]   = "raw_wrsr",
+};
+
+static struct {
+	enum host_op op;
+	bool started;
+	uint64_t t_start;
+	uint64_t t_wait;	/* Transfer in progress until then */
+
+	uint32_t base;
+	uint32_t len;
+	uint32_t ofs;		/* In the operation */
+	unsigned blk_ofs;	/* In the current block */
+	bool blk_valid;
+	bool erased;		/* Sector erase requested for the current page */
+
+	uint8_t *ref;
+	uint8_t blk[DFU_XFER_SIZE] __attribute__((aligned(4)));
+	uint8_t raw[4 + RAW_CHUNK] __attribute__((aligned(4)));
+	uint32_t vnd[2 + MAP_SECTORS];
+
+	int errors;
+} g_op;
+
+
+static void
+op_check(const char *op, uint32_t addr, const uint8_t *data, unsigned len)
+{
+	const uint8_t *ref = &g_op.ref[addr - g_op.base];
+
+	if (!memcmp(data, ref, len) && !memcmp(&flash_model_mem()[addr], ref, len))
+		return;
+
+	fprintf(stderr, "[!] %s : data mismatch in [%08x, %08x)\n", op, addr, addr + len);
+	g_op.errors++;
+}
+
+static void
+op_xfer(unsigned len)
+{
+	g_op.t_wait = g_ticks + USB_XFER_TICKS + len * USB_BYTE_TICKS;
+}
+
+
+static bool op_ctrl(uint8_t type, uint8_t req, uint16_t wValue, void *data, unsigned len);
+
+static void
+op_download_start(void)
+{
+	/* Marker in the rest of the zone */
+	memset(&flash_model_mem()[g_op.base + g_op.len], 0x5a, g_usb.zones[DL_ZONE].end - g_op.base - g_op.len);
+
+	/* Erase ahead length hint, in sectors */
+	op_ctrl(0x41, 0x11, (g_op.len + 4095) >> 12, NULL, 0);
+}
+
+static void
+op_download_end(void)
+{
+	const uint8_t *mem = flash_model_mem();
+	uint32_t addr;
+
+	/* Zero length block */
+	op_ctrl(0x21, 0x01, 0, NULL, 0);
+
+	for (addr=g_op.base+g_op.len; addr<g_usb.zones[DL_ZONE].end; addr++) {
+		if (mem[addr] == 0x5a)
+			continue;
+		fprintf(stderr, "[!] download : erased past the image at %08x\n", addr);
+		g_op.errors++;
+		break;
+	}
+}
+
+static bool
+op_download(void)
+{
+	uint32_t addr;
+
+	/* Done when the last page is programmed */
+	if (g_op.ofs >= g_op.len) {
+		if (usb_dfu_cb_flash_busy())
+			return false;
+		op_download_end();
+		return true;
+	}
+
+
+	/* Get a block */
+	if (!g_op.blk_valid) {
+		memcpy(g_op.blk, &g_op.ref[g_op.ofs], DFU_XFER_SIZE);
+		g_op.blk_valid = true;
+		op_xfer(DFU_XFER_SIZE);
+		return false;
+	}
+
+	/* One flash operation per poll, each one waits for the previous */
+	if (usb_dfu_cb_flash_busy())
+		return false;
+
+	addr = g_op.base + g_op.ofs + g_op.blk_ofs;
+
+	if (!(addr & 4095) && !g_op.erased) {
+		usb_dfu_cb_flash_erase(addr, 4096);
+		g_op.erased = true;
+		return false;
+	}
+
+	usb_dfu_cb_flash_program(&g_op.blk[g_op.blk_ofs], addr, 256);
+	g_op.erased = false;
+	g_op.blk_ofs += 256;
+
+	if (g_op.blk_ofs == DFU_XFER_SIZE) {
+		g_op.ofs += DFU_XFER_SIZE;
+		g_op.blk_ofs = 0;
+		g_op.blk_valid = false;
+	}
+
+	return false;
+}
+
+static bool
+op_upload(void)
+{
+	uint32_t addr = g_op.base + g_op.ofs;
+
+	if (g_op.ofs >= g_op.len)
+		return true;
+
+	usb_dfu_cb_flash_read(g_op.blk, addr, DFU_XFER_SIZE);
+	op_check("upload", addr, g_op.blk, DFU_XFER_SIZE);
+
+	g_op.ofs += DFU_XFER_SIZE;
+	op_xfer(DFU_XFER_SIZE);
+
+	return false;
+}
+
+static bool
+op_raw_read(void)
+{
+	uint32_t addr = g_op.base + g_op.ofs;
+
+	if (g_op.ofs >= RAW_SIZE)
+		return true;
+
+	g_op.raw[0] = 0x03;
+	g_op.raw[1] = addr >> 16;
+	g_op.raw[2] = addr >>  8;
+	g_op.raw[3] = addr;
+	memset(&g_op.raw[4], 0x00, RAW_CHUNK);
+
+	usb_dfu_cb_flash_raw(g_op.raw, sizeof(g_op.raw));
+	op_check("raw_read", addr, &g_op.raw[4], RAW_CHUNK);
+
+	/* Command, then result */
+	g_op.ofs += RAW_CHUNK;
+	op_xfer(sizeof(g_op.raw));
+	g_op.t_wait += USB_XFER_TICKS + sizeof(g_op.raw) * USB_BYTE_TICKS;
+
+	return false;
+}
+
+static bool
+op_ctrl(uint8_t type, uint8_t req, uint16_t wValue, void *data, unsigned len)
+{
+	struct usb_ctrl_req cr = {
+		.bmRequestType = type,
+		.bRequest      = req,
+		.wValue        = wValue,
+		.wIndex        = 0,
+		.wLength       = len,
+	};
+	struct usb_xfer xfer = { 0 };
+
+	if (g_usb.drv->ctrl_req(&cr, &xfer) != USB_FND_SUCCESS)
+		return false;
+
+	if (type & 0x80)
+		memcpy(data, xfer.data, ((unsigned)xfer.len < len) ? (unsigned)xfer.len : len);
+	else if (len)
+		memcpy(xfer.data, data, len);
+
+	if (xfer.cb_done)
+		xfer.cb_done(&xfer);
+
+	op_xfer(len);
+
+	return true;
+}
+
+static bool
+op_sector_map(void)
+{
+	int i;
+
+	/* Result checked, waiting for the last transfer */
+	if (g_op.ofs > 1)
+		return true;
+
+	/* Start */
+	if (!g_op.ofs) {
+		g_op.vnd[0] = g_op.base;
+		g_op.vnd[1] = MAP_SECTORS;
+		if (!op_ctrl(0x41, 0x14, 0, g_op.vnd, 8)) {
+			fprintf(stderr, "[!] sector_map : request rejected\n");
+			g_op.errors++;
+			return true;
+		}
+		g_op.ofs = 1;
+		return false;
+	}
+
+	/* Poll for the result */
+	op_ctrl(0xc1, 0x14, 0, g_op.vnd, sizeof(g_op.vnd));
+
+	if (g_op.vnd[0] != MAP_SECTORS) {
+		fprintf(stderr, "[!] sector_map : refused (%u sectors)\n", g_op.vnd[0]);
+		g_op.errors++;
+		g_op.ofs = 2;
+		return false;
+	}
+
+	if (g_op.vnd[1] < MAP_SECTORS)
+		return false;
+
+	for (i=0; i<MAP_SECTORS; i++) {
+		if (g_op.vnd[2+i] == crc32(0, &g_op.ref[i << 12], 4096))
+			continue;
+		fprintf(stderr, "[!] sector_map : CRC mismatch for sector %d\n", i);
+		g_op.errors++;
+	}
+
+	g_op.ofs = 2;
+
+	return false;
+}
+
+static bool
+op_patch(void)
+{
+	const uint8_t *mem = flash_model_mem();
+	uint32_t addr = g_op.base + PATCH_OFS;
+	uint8_t st[4];
+
+	/* Result checked, waiting for the last transfer */
+	if (g_op.ofs > 1)
+		return true;
+
+	/* Start */
+	if (!g_op.ofs) {
+		g_op.raw[0] = addr;
+		g_op.raw[1] = addr >>  8;
+		g_op.raw[2] = addr >> 16;
+		g_op.raw[3] = addr >> 24;
+		memcpy(&g_op.raw[4], g_op.ref, PATCH_LEN);
+
+		if (!op_ctrl(0x41, 0x13, 0, g_op.raw, 4 + PATCH_LEN)) {
+			fprintf(stderr, "[!] patch : request rejected\n");
+			g_op.errors++;
+			return true;
+		}
+		g_op.ofs = 1;
+		return false;
+	}
+
+	/* Poll for the result (1 = busy) */
+	op_ctrl(0xc1, 0x13, 0, st, sizeof(st));
+
+	if (st[0] == 1)
+		return false;
+
+	if (st[0]) {
+		fprintf(stderr, "[!] patch : failed (%d)\n", st[0]);
+		g_op.errors++;
+	} else if (memcmp(&mem[addr], g_op.ref, PATCH_LEN) ||
+	           (mem[addr-1] != 0x5a) || (mem[addr+PATCH_LEN] != 0x5a)) {
+		fprintf(stderr, "[!] patch : data mismatch @%08x\n", addr);
+		g_op.errors++;
+	}
+
+	g_op.ofs = 2;
+
+	return false;
+}
+
+static bool
+op_raw_wrsr(void)
+{
+	uint32_t addr = g_op.base;
+	uint8_t cmd[3] = { 0x06, 0x00, 0x00 };
+
+	switch (g_op.ofs++) {
+	case 0:
+		/* Write enable */
+		usb_dfu_cb_flash_raw(cmd, 1);
+		op_xfer(1);
+		return false;
+
+	case 1:
+		/* SR1 / SR2 write, the read below comes well within tW */
+		cmd[0] = 0x01;
+		usb_dfu_cb_flash_raw(cmd, 3);
+		op_xfer(3);
+		return false;
+
+	case 2:
+		g_op.raw[0] = 0x03;
+		g_op.raw[1] = addr >> 16;
+		g_op.raw[2] = addr >>  8;
+		g_op.raw[3] = addr;
+		memset(&g_op.raw[4], 0x00, RAW_CHUNK);
+
+		usb_dfu_cb_flash_raw(g_op.raw, sizeof(g_op.raw));
+		op_check("raw_wrsr", addr, &g_op.raw[4], RAW_CHUNK);
+
+		op_xfer(sizeof(g_op.raw));
+		return false;
+
+	default:
+		return true;
+	}
+}
+
+
+// ---------------------------------------------------------------------------
+// Poll
+// ---------------------------------------------------------------------------
+
+static void
+op_start(void)
+{
+	g_op.started = true;
+	g_op.t_start = g_ticks;
+	g_op.t_wait  = g_ticks;
+
+	g_op.base = g_usb.zones[DL_ZONE].start;
+	g_op.len  = DL_SIZE;
+	g_op.ofs  = 0;
+	g_op.blk_ofs = 0;
+	g_op.blk_valid = false;
+	g_op.erased = false;
+
+	host_stats_reset();
+
+	if (g_op.op == OP_DOWNLOAD)
+		op_download_start();
+}
+
+static void
+op_end(void)
+{
+	static const unsigned bytes[] = {
+		[OP_DOWNLOAD]   = DL_SIZE,
+		[OP_UPLOAD]     = DL_SIZE,
+		[OP_RAW_READ]   = RAW_SIZE,
+		[OP_SECTOR_MAP] = DL_SIZE,
+		[OP_PATCH]      = PATCH_LEN,
+		[OP_RAW_WRSR]   = RAW_CHUNK,
+	};
+
+	host_report(op_names[g_op.op], g_ticks - g_op.t_start, bytes[g_op.op]);
+
+	g_op.started = false;
+	g_op.op++;
+
+	if (g_op.op != OP_DONE)
+		return;
+
+	fprintf(stderr, "Host test: %s\n", g_op.errors ? "FAIL" : "PASS");
+	fflush(stdout);
+	exit(g_op.errors ? 1 : 0);
+}
+
+void
+usb_poll(void)
+{
+	bool done;
+	int i;
+
+	g_ticks += USB_POLL_TICKS;
+	g_stats.usb_polls++;
+
+	/* Reference data, pseudo random */
+	if (!g_op.ref) {
+		uint32_t x = 0x12345678;
+
+		g_op.ref = malloc(DL_SIZE);
+		for (i=0; i<DL_SIZE; i++) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			g_op.ref[i] = x;
+		}
+	}
+
+	if (!g_op.started)
+		op_start();
+
+	if (g_ticks < g_op.t_wait)
+		return;
+
+	switch (g_op.op) {
+	case OP_DOWNLOAD:   done = op_download();   break;
+	case OP_UPLOAD:     done = op_upload();     break;
+	case OP_RAW_READ:   done = op_raw_read();   break;
+	case OP_SECTOR_MAP: done = op_sector_map(); break;
+	case OP_PATCH:      done = op_patch();      break;
+	case OP_RAW_WRSR:   done = op_raw_wrsr();   break;
+	default:            done = true;            break;
+	}
+
+	/* Wait for the last transfer */
+	if (done && (g_ticks >= g_op.t_wait))
+		op_end();
+}
@@ -24,6 +24,8 @@ struct spi {
 	uint32_t txdr;		/* 1101 - TXDR     - Transmit Data Register */
 	uint32_t rxdr;		/* 1110 - RXDR     - Receive Data Register  */
 	uint32_t csr;		/* 1111 - CSR      - Chip Select Register   */
+	uint32_t wtx;		/* Stream shim: push 4 TX bytes */
+	uint32_t poll;		/* Stream shim: flash busy poller */
 } __attribute__((packed,aligned(4)));
 
 #define SPI_CR0_TIDLE(xcnt)	(((xcnt) & 3) << 6)
@@ -49,6 +51,12 @@ struct spi {
 #define SPI_SR_ROE		(1 << 1)
 #define SPI_SR_MDF		(1 << 0)
 
+#define SPI_POLL_START		(1 << 31)
+#define SPI_POLL_RUN		(1 << 31)
+#define SPI_POLL_DONE		(1 << 8)
+#define SPI_POLL_CS(cs)		(((cs) & 3) << 16)
+#define SPI_POLL_IVAL(clk)	((clk) & 0xffff)
+
 
 static volatile struct spi * const spi_regs = (void*)(SPI_BASE);
 
@@ -75,7 +83,17 @@ spi_xfer(unsigned cs, struct spi_xfer_chunk *xfer, unsigned n)
 
 	/* Run the chunks */
 	while (n--) {
-		for (int i=0; i<xfer->len; i++)
+		int i = 0;
+
+		/* Write only data can be pushed by words, the gateware deals
+		 * with the per-byte handshake and discards RX */
+		if (xfer->write && !xfer->read && !((uintptr_t)xfer->data & 3)) {
+			const uint32_t *w = (const uint32_t *)xfer->data;
+			for (; i<(xfer->len & ~3); i+=4)
+				spi_regs->wtx = *w++;
+		}
+
+		for (; i<xfer->len; i++)
 		{
 			spi_regs->txdr = xfer->write ? xfer->data[i] : 0x00;
 			while (!(spi_regs->sr & SPI_SR_RRDY));
@@ -96,6 +114,8 @@ spi_xfer(unsigned cs, struct spi_xfer_chunk *xfer, unsigned n)
 #define FLASH_CMD_WRITE_ENABLE		0x06
 #define FLASH_CMD_WRITE_ENABLE_VOLATILE	0x50
 #define FLASH_CMD_WRITE_DISABLE		0x04
+#define FLASH_CMD_SUSPEND		0x75
+#define FLASH_CMD_RESUME		0x7a
 
 #define FLASH_CMD_READ_MANUF_ID		0x9f
 #define FLASH_CMD_READ_UNIQUE_ID	0x4b
@@ -108,12 +128,47 @@ spi_xfer(unsigned cs, struct spi_xfer_chunk *xfer, unsigned n)
 #define FLASH_CMD_WRITE_SR3		0x11
 
 #define FLASH_CMD_READ_DATA		0x03
+#define FLASH_CMD_FAST_READ		0x0b
+#define FLASH_CMD_READ_SFDP		0x5a
 #define FLASH_CMD_PAGE_PROGRAM		0x02
 #define FLASH_CMD_CHIP_ERASE		0x60
 #define FLASH_CMD_SECTOR_ERASE		0x20
 #define FLASH_CMD_BLOCK_ERASE_32k	0x52
 #define FLASH_CMD_BLOCK_ERASE_64k	0xd8
 
+#define FLASH_CMD_READ_DATA_4B		0x13
+#define FLASH_CMD_FAST_READ_4B		0x0c
+#define FLASH_CMD_PAGE_PROGRAM_4B	0x12
+#define FLASH_CMD_SECTOR_ERASE_4B	0x21
+#define FLASH_CMD_BLOCK_ERASE_32k_4B	0x5c
+#define FLASH_CMD_BLOCK_ERASE_64k_4B	0xdc
+
+#define FLASH_SR1_BUSY			(1 << 0)
+#define FLASH_SR1_WEL			(1 << 1)
+
+/* Busy poller interval (24 MHz clocks). A status read takes ~3 us */
+#define FLASH_POLL_INTERVAL		(24 * 10)
+
+/* Flash seen idle since the last command that can make it busy. Those all
+ * go through a write enable, a resume or start the busy poller */
+static bool g_flash_idle;
+
+/* Safe defaults, refined by flash_discover() */
+static struct flash_info g_flash_info = {
+	.size       = 0,
+	.addr_len   = 3,
+	.read_op    = FLASH_CMD_READ_DATA,
+	.read_dummy = 0,
+	.prog_op    = FLASH_CMD_PAGE_PROGRAM,
+	.spi_br     = 3,
+	.n_erase    = 3,
+	.erase      = {
+		{ FLASH_CMD_SECTOR_ERASE,    12 },
+		{ FLASH_CMD_BLOCK_ERASE_32k, 15 },
+		{ FLASH_CMD_BLOCK_ERASE_64k, 16 },
+	},
+};
+
 void
 flash_cmd(uint8_t cmd)
 {
@@ -138,12 +193,14 @@ flash_wake_up(void)
 void
 flash_write_enable(void)
 {
+	g_flash_idle = false;
 	flash_cmd(FLASH_CMD_WRITE_ENABLE);
 }
 
 void
 flash_write_enable_volatile(void)
 {
+	g_flash_idle = false;
 	flash_cmd(FLASH_CMD_WRITE_ENABLE_VOLATILE);
 }
 
@@ -153,6 +210,20 @@ flash_write_disable(void)
 	flash_cmd(FLASH_CMD_WRITE_DISABLE);
 }
 
+void
+flash_suspend(void)
+{
+	flash_cmd(FLASH_CMD_SUSPEND);
+	flash_poll_start();
+}
+
+void
+flash_resume(void)
+{
+	flash_cmd(FLASH_CMD_RESUME);
+	flash_poll_start();
+}
+
 void
 flash_manuf_id(void *manuf)
 {
@@ -195,6 +266,49 @@ flash_read_sr(int srno)
 	return rv;
 }
 
+/*
+ * Status polling is done by the SPI shim in the background, started after
+ * each command that makes the flash busy. Any other SPI access stops it,
+ * in which case we just ask the flash.
+ */
+void
+flash_poll_start(void)
+{
+	g_flash_idle = false;
+	spi_regs->poll = SPI_POLL_START | SPI_POLL_CS(SPI_CS_FLASH) | SPI_POLL_IVAL(FLASH_POLL_INTERVAL);
+}
+
+uint8_t
+flash_status(void)
+{
+	uint32_t v = spi_regs->poll;
+
+	/* Once done, the poller holds the SR1 read after the operation,
+	 * otherwise do a real read (stopping the poller if running) */
+	if (v & SPI_POLL_DONE)
+		return v & 0xff;
+
+	return flash_read_sr(1);
+}
+
+bool
+flash_busy(void)
+{
+	uint32_t v = spi_regs->poll;
+
+	if (v & SPI_POLL_RUN)
+		return true;
+	if (v & SPI_POLL_DONE) {
+		g_flash_idle = true;
+		return false;
+	}
+	if (g_flash_idle)
+		return false;
+
+	g_flash_idle = !(flash_read_sr(1) & FLASH_SR1_BUSY);
+	return !g_flash_idle;
+}
+
 void
 flash_write_sr(int srno, uint8_t srval)
 {
@@ -212,52 +326,274 @@ flash_write_sr(int srno, uint8_t srval)
 	spi_xfer(SPI_CS_FLASH, xfer, 1);
 }
 
+/*
+ * Large parts use the dedicated 4 byte address opcodes rather than the
+ * 4 byte address mode : there is no mode to track or restore (the iCE40
+ * configuration logic and the boot stub only do 3 byte addressing) and
+ * accesses anywhere in the array cost the same.
+ */
+static unsigned
+_flash_cmd_addr(uint8_t *cmd, uint8_t op, uint32_t addr)
+{
+	unsigned n = g_flash_info.addr_len;
+
+	cmd[0] = op;
+	for (int i=n; i>0; i--) {
+		cmd[i] = addr & 0xff;
+		addr >>= 8;
+	}
+
+	return n + 1;
+}
+
 void
 flash_read(void *dst, uint32_t addr, unsigned len)
 {
-	uint8_t cmd[4] = { FLASH_CMD_READ_DATA, ((addr >> 16) & 0xff), ((addr >> 8) & 0xff), (addr & 0xff)  };
-	struct spi_xfer_chunk xfer[2] = {
-		{ .data = (void*)cmd, .len = 4,   .read = false, .write = true,  },
+	uint8_t cmd[5];
+	struct spi_xfer_chunk xfer[3] = {
+		{ .data = (void*)cmd, .len = 0,   .read = false, .write = true,  },
+		{ .data = (void*)0,   .len = g_flash_info.read_dummy, .read = false, .write = false, },
 		{ .data = (void*)dst, .len = len, .read = true,  .write = false, },
 	};
-	spi_xfer(SPI_CS_FLASH, xfer, 2);
+	xfer[0].len = _flash_cmd_addr(cmd, g_flash_info.read_op, addr);
+	spi_xfer(SPI_CS_FLASH, xfer, 3);
 }
 
 void
 flash_page_program(const void *src, uint32_t addr, unsigned len)
 {
-	uint8_t cmd[4] = { FLASH_CMD_PAGE_PROGRAM, ((addr >> 16) & 0xff), ((addr >> 8) & 0xff), (addr & 0xff)  };
+	uint8_t cmd[5];
 	struct spi_xfer_chunk xfer[2] = {
-		{ .data = (void*)cmd, .len = 4,   .read = false, .write = true, },
+		{ .data = (void*)cmd, .len = 0,   .read = false, .write = true, },
 		{ .data = (void*)src, .len = len, .read = false, .write = true, },
 	};
+	xfer[0].len = _flash_cmd_addr(cmd, g_flash_info.prog_op, addr);
 	spi_xfer(SPI_CS_FLASH, xfer, 2);
+	flash_poll_start();
 }
 
 static void
 _flash_erase(uint8_t cmd_byte, uint32_t addr)
 {
-	uint8_t cmd[4] = { cmd_byte, ((addr >> 16) & 0xff), ((addr >> 8) & 0xff), (addr & 0xff)  };
+	uint8_t cmd[5];
 	struct spi_xfer_chunk xfer[1] = {
-		{ .data = (void*)cmd, .len = 4,   .read = false, .write = true,  },
+		{ .data = (void*)cmd, .len = 0,   .read = false, .write = true,  },
 	};
+	xfer[0].len = _flash_cmd_addr(cmd, cmd_byte, addr);
 	spi_xfer(SPI_CS_FLASH, xfer, 1);
+	flash_poll_start();
 }
 
-void
+bool
 flash_sector_erase(uint32_t addr)
 {
-	_flash_erase(FLASH_CMD_SECTOR_ERASE, addr);
+	return flash_erase_block(addr, 4096);
 }
 
-void
+bool
 flash_block_erase_32k(uint32_t addr)
 {
-	_flash_erase(FLASH_CMD_BLOCK_ERASE_32k, addr);
+	return flash_erase_block(addr, 32768);
 }
 
-void
+bool
 flash_block_erase_64k(uint32_t addr)
 {
-	_flash_erase(FLASH_CMD_BLOCK_ERASE_64k, addr);
+	return flash_erase_block(addr, 65536);
+}
+
+
+// ---------------------------------------------------------------------------
+// SFDP discovery
+// ---------------------------------------------------------------------------
+
+#define SFDP_SIGNATURE		0x50444653	/* 'SFDP' */
+#define SFDP_ID_4BAIT		0xff84		/* 4 Byte Address Instruction Table */
+
+/* Erase opcodes for 4 byte addresses, when there is no 4BAIT */
+static uint8_t
+_flash_op_4b(uint8_t op)
+{
+	switch (op) {
+	case FLASH_CMD_SECTOR_ERASE:    return FLASH_CMD_SECTOR_ERASE_4B;
+	case FLASH_CMD_BLOCK_ERASE_32k: return FLASH_CMD_BLOCK_ERASE_32k_4B;
+	case FLASH_CMD_BLOCK_ERASE_64k: return FLASH_CMD_BLOCK_ERASE_64k_4B;
+	default:                        return 0;
+	}
+}
+
+/* Read (the start of) the parameter table with the given ID */
+static bool
+_flash_sfdp_table(const uint32_t *hdr, unsigned id, void *dst, unsigned len)
+{
+	uint32_t ph[2];
+	int i, n;
+
+	n = ((hdr[1] >> 16) & 0xff) + 1;
+
+	for (i=1; i<n; i++) {
+		flash_sfdp_read(ph, 8 + (i << 3), sizeof(ph));
+		if (((ph[0] & 0xff) | ((ph[1] >> 16) & 0xff00)) != id)
+			continue;
+		if (((ph[0] >> 24) << 2) < len)
+			return false;
+		flash_sfdp_read(dst, ph[1] & 0xffffff, len);
+		return true;
+	}
+
+	return false;
+}
+
+void
+flash_sfdp_read(void *dst, uint32_t addr, unsigned len)
+{
+	uint8_t cmd[5] = { FLASH_CMD_READ_SFDP, ((addr >> 16) & 0xff), ((addr >> 8) & 0xff), (addr & 0xff), 0x00 };
+	struct spi_xfer_chunk xfer[2] = {
+		{ .data = (void*)cmd, .len = 5,   .read = false, .write = true,  },
+		{ .data = (void*)dst, .len = len, .read = true,  .write = false, },
+	};
+	spi_xfer(SPI_CS_FLASH, xfer, 2);
+}
+
+bool
+flash_discover(void)
+{
+	struct flash_info fi = g_flash_info;
+	uint32_t hdr[4];
+	uint32_t bfpt[9];
+	uint32_t t4b[2];
+	bool has_t4b = false;
+	uint8_t op;
+	uint32_t v;
+	int i, j;
+
+	/* SFDP header and first parameter header (always the BFPT) */
+	flash_sfdp_read(hdr, 0, sizeof(hdr));
+
+	if ((hdr[0] != SFDP_SIGNATURE) || ((hdr[2] & 0xff) != 0x00) || ((hdr[2] >> 24) < 9))
+		return false;
+
+	/* Basic Flash Parameter Table, JESD216 rev 0 part */
+	flash_sfdp_read(bfpt, hdr[3] & 0xffffff, sizeof(bfpt));
+
+		/* Density */
+	v = bfpt[1] & 0x7fffffff;
+	if (bfpt[1] & 0x80000000)
+		fi.size = (v >= 35) ? 0 : ((uint32_t)1 << (v - 3));
+	else
+		fi.size = (v + 1) >> 3;
+
+		/* Address bytes (0: 3 only, 1: 3 or 4, 2: 4 only). Above 16M,
+		 * use the 4 byte opcodes, from the 4BAIT if there is one */
+	v = (bfpt[0] >> 17) & 3;
+	if ((v == 2) || ((v == 1) && (!fi.size || (fi.size > (1 << 24))))) {
+		fi.addr_len = 4;
+		has_t4b = _flash_sfdp_table(hdr, SFDP_ID_4BAIT, t4b, sizeof(t4b));
+
+		/* Needs Read (bit 0) and Page Program (bit 6) */
+		if (has_t4b && ((t4b[0] & 0x41) != 0x41))
+			return false;
+	} else {
+		fi.addr_len = 3;
+	}
+
+		/* Erase types */
+	fi.n_erase = 0;
+
+	for (i=0; i<4; i++) {
+		v = (bfpt[7 + (i >> 1)] >> ((i & 1) << 4)) & 0xffff;
+		if (!(v & 0xff))
+			continue;
+
+		op = v >> 8;
+		if (fi.addr_len == 4) {
+			if (has_t4b)
+				op = (t4b[0] & (1 << (9 + i))) ? ((t4b[1] >> (i << 3)) & 0xff) : 0;
+			else
+				op = _flash_op_4b(op);
+			if (!op)
+				continue;
+		}
+
+		/* Insert sorted */
+		for (j=fi.n_erase; (j > 0) && (fi.erase[j-1].shift > (v & 0xff)); j--)
+			fi.erase[j] = fi.erase[j-1];
+
+		fi.erase[j].shift = v & 0xff;
+		fi.erase[j].op    = op;
+		fi.n_erase++;
+	}
+
+	if (!fi.n_erase)
+		return false;
+
+		/* The SPI clock is kept as is : the BFPT has no maximum clock
+		 * and the limit on these boards is the SB_SPI / board timing
+		 * rather than the flash, so nothing here allows going faster.
+		 * Plain Read is fine at that rate, Fast Read would only add
+		 * 8 dummy clocks */
+	fi.read_op    = (fi.addr_len == 4) ? FLASH_CMD_READ_DATA_4B : FLASH_CMD_READ_DATA;
+	fi.read_dummy = 0;
+	fi.prog_op    = (fi.addr_len == 4) ? FLASH_CMD_PAGE_PROGRAM_4B : FLASH_CMD_PAGE_PROGRAM;
+
+	/* Apply */
+	g_flash_info = fi;
+	spi_regs->br = fi.spi_br;
+
+	return true;
+}
+
+const struct flash_info *
+flash_get_info(void)
+{
+	return &g_flash_info;
+}
+
+bool
+flash_erase_block(uint32_t addr, unsigned size)
+{
+	unsigned sz = 0;
+	int i;
+
+	/* Largest supported erase that tiles the block */
+	for (i=g_flash_info.n_erase-1; i>=0; i--) {
+		sz = 1 << g_flash_info.erase[i].shift;
+		if ((sz <= size) && !((addr | size) & (sz - 1)))
+			break;
+	}
+
+	if (i < 0)
+		return false;
+
+	/* Without an erase of that size, loop with the smaller one. All but
+	 * the last one are waited for */
+	while (1) {
+		_flash_erase(g_flash_info.erase[i].op, addr);
+
+		addr += sz;
+		size -= sz;
+
+		if (!size)
+			return true;
+
+		while (flash_busy());
+		flash_write_enable();
+	}
+}
+
+unsigned
+flash_erase_best(uint32_t addr, uint32_t end)
+{
+	unsigned size;
+	int i;
+
+	/* Largest aligned erase within [addr, end) */
+	for (i=g_flash_info.n_erase-1; i>=0; i--) {
+		size = 1 << g_flash_info.erase[i].shift;
+		if (!(addr & (size - 1)) && ((addr + size) <= end))
+			return size;
+	}
+
+	/* Smallest one otherwise */
+	return 1 << g_flash_info.erase[0].shift;
 }
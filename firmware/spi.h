@@ -19,6 +19,20 @@ struct spi_xfer_chunk {
 #define SPI_CS_FLASH	0
 #define SPI_CS_SRAM	1
 
+struct flash_info {
+	uint32_t size;		/* In bytes, 0 if unknown */
+	uint8_t  addr_len;	/* 3 or 4 bytes */
+	uint8_t  read_op;
+	uint8_t  read_dummy;	/* In bytes */
+	uint8_t  prog_op;
+	uint8_t  spi_br;
+	uint8_t  n_erase;
+	struct {
+		uint8_t op;
+		uint8_t shift;	/* log2(size) */
+	} erase[4];		/* Smallest first */
+};
+
 void spi_init(void);
 void spi_xfer(unsigned cs, struct spi_xfer_chunk *xfer, unsigned n);
 
@@ -27,12 +41,23 @@ void flash_deep_power_down(void);
 void flash_wake_up(void);
 void flash_write_enable(void);
 void flash_write_disable(void);
+void flash_suspend(void);
+void flash_resume(void);
 void flash_manuf_id(void *manuf);
 void flash_unique_id(void *id);
 uint8_t flash_read_sr(int srno);
+void flash_poll_start(void);
+uint8_t flash_status(void);
+bool flash_busy(void);
 void flash_write_sr(int srno, uint8_t srval);
 void flash_read(void *dst, uint32_t addr, unsigned len);
 void flash_page_program(const void *src, uint32_t addr, unsigned len);
-void flash_sector_erase(uint32_t addr);
-void flash_block_erase_32k(uint32_t addr);
-void flash_block_erase_64k(uint32_t addr);
+bool flash_sector_erase(uint32_t addr);
+bool flash_block_erase_32k(uint32_t addr);
+bool flash_block_erase_64k(uint32_t addr);
+
+void flash_sfdp_read(void *dst, uint32_t addr, unsigned len);
+bool flash_discover(void);
+const struct flash_info *flash_get_info(void);
+bool flash_erase_block(uint32_t addr, unsigned size);
+unsigned flash_erase_best(uint32_t addr, uint32_t end);
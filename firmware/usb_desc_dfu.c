@@ -11,6 +11,13 @@
 #include <no2usb/usb.h>
 
 
+/*
+ * Blocks are erased / programmed as whole sectors, and the no2usb DFU core
+ * receives them in a 4k buffer, so that's also the largest usable size.
+ */
+#define DFU_XFER_SIZE	4096
+
+/* Alt settings are the fw_dfu.c zones, new ones only ever get appended */
 static const struct {
 	struct usb_conf_desc conf;
 	struct usb_intf_desc if_fpga;
@@ -21,6 +28,16 @@ static const struct {
 	struct usb_dfu_func_desc dfu_bl_fpga;
 	struct usb_intf_desc if_bl_riscv;
 	struct usb_dfu_func_desc dfu_bl_riscv;
+	struct usb_intf_desc if_fpga_b;
+	struct usb_dfu_func_desc dfu_fpga_b;
+	struct usb_intf_desc if_riscv_b;
+	struct usb_dfu_func_desc dfu_riscv_b;
+	struct usb_intf_desc if_combined;
+	struct usb_dfu_func_desc dfu_combined;
+#ifdef DFU_DATA_START
+	struct usb_intf_desc if_data;
+	struct usb_dfu_func_desc dfu_data;
+#endif
 } __attribute__ ((packed)) _dfu_conf_desc = {
 	.conf = {
 		.bLength                = sizeof(struct usb_conf_desc),
@@ -48,7 +65,7 @@ static const struct {
 		.bDescriptorType	= USB_DFU_DT_FUNC,
 		.bmAttributes		= 0x0f,
 		.wDetachTimeOut		= 0,
-		.wTransferSize		= 4096,
+		.wTransferSize		= DFU_XFER_SIZE,
 		.bcdDFUVersion		= 0x0101,
 	},
 	.if_riscv = {
@@ -67,7 +84,7 @@ static const struct {
 		.bDescriptorType	= USB_DFU_DT_FUNC,
 		.bmAttributes		= 0x0f,
 		.wDetachTimeOut		= 0,
-		.wTransferSize		= 4096,
+		.wTransferSize		= DFU_XFER_SIZE,
 		.bcdDFUVersion		= 0x0101,
 	},
 	.if_bl_fpga = {
@@ -86,7 +103,7 @@ static const struct {
 		.bDescriptorType	= USB_DFU_DT_FUNC,
 		.bmAttributes		= 0x0f,
 		.wDetachTimeOut		= 0,
-		.wTransferSize		= 4096,
+		.wTransferSize		= DFU_XFER_SIZE,
 		.bcdDFUVersion		= 0x0101,
 	},
 	.if_bl_riscv = {
@@ -105,9 +122,87 @@ static const struct {
 		.bDescriptorType	= USB_DFU_DT_FUNC,
 		.bmAttributes		= 0x0f,
 		.wDetachTimeOut		= 0,
-		.wTransferSize		= 4096,
+		.wTransferSize		= DFU_XFER_SIZE,
 		.bcdDFUVersion		= 0x0101,
 	},
+	.if_fpga_b = {
+		.bLength		= sizeof(struct usb_intf_desc),
+		.bDescriptorType	= USB_DT_INTF,
+		.bInterfaceNumber	= 0,
+		.bAlternateSetting	= 4,
+		.bNumEndpoints		= 0,
+		.bInterfaceClass	= 0xfe,
+		.bInterfaceSubClass	= 0x01,
+		.bInterfaceProtocol	= 0x02,
+		.iInterface		= 9,
+	},
+	.dfu_fpga_b = {
+		.bLength		= sizeof(struct usb_dfu_func_desc),
+		.bDescriptorType	= USB_DFU_DT_FUNC,
+		.bmAttributes		= 0x0f,
+		.wDetachTimeOut		= 0,
+		.wTransferSize		= DFU_XFER_SIZE,
+		.bcdDFUVersion		= 0x0101,
+	},
+	.if_riscv_b = {
+		.bLength		= sizeof(struct usb_intf_desc),
+		.bDescriptorType	= USB_DT_INTF,
+		.bInterfaceNumber	= 0,
+		.bAlternateSetting	= 5,
+		.bNumEndpoints		= 0,
+		.bInterfaceClass	= 0xfe,
+		.bInterfaceSubClass	= 0x01,
+		.bInterfaceProtocol	= 0x02,
+		.iInterface		= 10,
+	},
+	.dfu_riscv_b = {
+		.bLength		= sizeof(struct usb_dfu_func_desc),
+		.bDescriptorType	= USB_DFU_DT_FUNC,
+		.bmAttributes		= 0x0f,
+		.wDetachTimeOut		= 0,
+		.wTransferSize		= DFU_XFER_SIZE,
+		.bcdDFUVersion		= 0x0101,
+	},
+	.if_combined = {
+		.bLength		= sizeof(struct usb_intf_desc),
+		.bDescriptorType	= USB_DT_INTF,
+		.bInterfaceNumber	= 0,
+		.bAlternateSetting	= 6,
+		.bNumEndpoints		= 0,
+		.bInterfaceClass	= 0xfe,
+		.bInterfaceSubClass	= 0x01,
+		.bInterfaceProtocol	= 0x02,
+		.iInterface		= 11,
+	},
+	.dfu_combined = {
+		.bLength		= sizeof(struct usb_dfu_func_desc),
+		.bDescriptorType	= USB_DFU_DT_FUNC,
+		.bmAttributes		= 0x0f,
+		.wDetachTimeOut		= 0,
+		.wTransferSize		= DFU_XFER_SIZE,
+		.bcdDFUVersion		= 0x0101,
+	},
+#ifdef DFU_DATA_START
+	.if_data = {
+		.bLength		= sizeof(struct usb_intf_desc),
+		.bDescriptorType	= USB_DT_INTF,
+		.bInterfaceNumber	= 0,
+		.bAlternateSetting	= 7,
+		.bNumEndpoints		= 0,
+		.bInterfaceClass	= 0xfe,
+		.bInterfaceSubClass	= 0x01,
+		.bInterfaceProtocol	= 0x02,
+		.iInterface		= 12,
+	},
+	.dfu_data = {
+		.bLength		= sizeof(struct usb_dfu_func_desc),
+		.bDescriptorType	= USB_DFU_DT_FUNC,
+		.bmAttributes		= 0x0f,
+		.wDetachTimeOut		= 0,
+		.wTransferSize		= DFU_XFER_SIZE,
+		.bcdDFUVersion		= 0x0101,
+	},
+#endif
 };
 
 static const struct usb_conf_desc * const _conf_desc_array[] = {
@@ -8,5 +8,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 char *hexstr(void *d, int n, bool space);
+uint32_t crc32(uint32_t crc, const void *d, unsigned n);
@@ -7,6 +7,16 @@
  * SPDX-License-Identifier: CERN-OHL-P-2.0
  */
 
+// All the lock sequences end with a single WRITE_SR (01h) of both SR1 and
+// SR2, which the assumed flashes all accept (W25Q80DV / W25Q64JV /
+// W25Q128JV, GD25Q16C, AT25SF161, and S25FL064L where the second byte is
+// CR1). flash_lock takes the lock check values from the WRITE_SR / WRITE_SR2
+// (31h) commands, so split writes work too (see sim/flash_lock_tb.v).
+//
+// W25Q writable protection bits for the lock check : BP/TB/SEC/SRP in SR1,
+// SRL/QE/CMP in SR2
+`define FLASH_LOCK_CHECK_W25Q { 8'hfc, 8'h43 }
+
 `ifdef BOARD_BITSY_V0
 	// 1bitsquared iCEbreaker bitsy prototypes (v0.x)
 	`define HAS_USB
@@ -21,6 +31,7 @@
 		2'b00, 8'h28,	/* SR1 value */ \
 		2'b11, 8'h03	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_BITSY_V1
 	// 1bitsquared iCEbreaker bitsy prod (v1.x)
 	`define HAS_USB
@@ -35,6 +46,7 @@
 		2'b00, 8'h28,	/* SR1 value */ \
 		2'b11, 8'h03	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_ICEBREAKER
 	// 1bitsquare iCEbreaker
 	`define HAS_USB
@@ -50,6 +62,7 @@
 		2'b00, 8'h28,	/* SR1 value */ \
 		2'b11, 8'h03	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_ICEPICK
 	// iCEpick
 	`define MISC_SEL 2'b01
@@ -76,6 +89,7 @@
 		2'b00, 8'h30,	/* SR1 value */ \
 		2'b11, 8'h01	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_E1TRACER
 	// osmocom E1 tracer
 	`define MISC_SEL 2'b01		// Compatibility with icepick proto
@@ -89,6 +103,7 @@
 		2'b00, 8'h30,	/* SR1 value */ \
 		2'b11, 8'h01	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_FOMU_HACKER
 	// FOMU Hacker version
 	`define HAS_USB
@@ -125,6 +140,7 @@
 		2'b00, 8'h28,	/* SR1 value */ \
 		2'b11, 8'h03	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_ICE40_USBTRACE
 	// iCE40 USB trace ( https://gitea.osmocom.org/electronics/ice40-usbtrace )
 	`define HAS_USB
@@ -138,6 +154,7 @@
 		2'b00, 8'h30,	/* SR1 value */ \
 		2'b11, 8'h01	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_ICE_DONGLE
 	// @emeb ice-dongle
 	`define HAS_USB
@@ -151,6 +168,7 @@
 		2'b00, 8'h28,	/* SR1 value */ \
 		2'b11, 8'h03	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_OSMO_AMR
 	// osmo-amr ( https://gitea.osmocom.org/retronetworking/osmo-amr )
 	`define HAS_USB
@@ -164,6 +182,7 @@
 		2'b00, 8'h30,	/* SR1 value */ \
 		2'b11, 8'h01	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `elsif BOARD_XMAS_SNOOPY
 	// @tnt xmas-snoopy led controller
 	`define HAS_USB
@@ -188,6 +207,7 @@
 		2'b00, 8'h28,	/* SR1 value */ \
 		2'b11, 8'h03	/* SR2 value */ \
 	}
+	`define FLASH_LOCK_CHECK_MASK `FLASH_LOCK_CHECK_W25Q
 `endif
 
 // Defaults
@@ -207,6 +227,13 @@
 `define RGB2_CURRENT "0b000001"
 `endif
 
+`ifndef FLASH_LOCK_CHECK_MASK
+// Bits of { SR1, SR2 } that, if they already hold the lock values, allow
+// skipping the lock sequence. Off for the boards whose flash status layout
+// wasn't checked, enabled above with the W25Q one.
+`define FLASH_LOCK_CHECK_MASK 16'h0000
+`endif
+
 `ifndef RGB_MAP
 // [11:8] - Color of RGB2 / pin 41
 // [ 7:0] - Color of RGB1 / pin 40
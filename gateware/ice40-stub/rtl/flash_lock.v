@@ -17,7 +17,14 @@ module flash_lock #(
 		2'b00, 8'h01,	// WRITE_SR
 		2'b00, 8'h28,	// SR1 value
 		2'b11, 8'h03	// SR2 value
-	}
+	},
+
+	// Optional check : If the current { SR1, SR2 } already match the
+	// values written by the lock sequence (for the bits set in CHECK_MASK),
+	// skip it. The values are taken from the WRITE_SR (01h, SR1 and
+	// optionally SR2) and WRITE_SR2 (31h) commands of the sequence, bits
+	// of a register it doesn't write are never compared
+	parameter [15:0] CHECK_MASK = 16'h0000
 )(
 	// SPI
 	output reg  spi_mosi,
@@ -28,13 +35,58 @@ module flash_lock #(
 	// Control
 	input  wire go,
 	output wire rdy,
+	output reg  skipped,
 
 	// Clock / Reset
 	input  wire clk,
 	input  wire rst
 );
 
-	localparam LOCK_N = $bits(LOCK_DATA) / 10;
+	localparam LOCK_BITS = $bits(LOCK_DATA);
+
+	// { written mask, value } of { SR1, SR2 } after the lock sequence
+	function [31:0] lock_sr;
+		input [LOCK_BITS-1:0] seq;
+		integer i, pos;
+		reg [9:0] e;
+		reg [7:0] op;
+		begin
+			lock_sr = 32'h00000000;
+			op  = 8'h00;
+			pos = 0;
+			for (i=0; i<LOCK_BITS/10; i=i+1) begin
+				e = seq[LOCK_BITS-10-i*10+:10];
+				if (pos == 0)
+					op = e[7:0];
+				else if ((op == 8'h01) && (pos == 1))
+					lock_sr = { 8'hff, lock_sr[23:16], e[7:0], lock_sr[7:0] };
+				else if (((op == 8'h01) && (pos == 2)) || ((op == 8'h31) && (pos == 1)))
+					lock_sr = { lock_sr[31:24], 8'hff, lock_sr[15:8], e[7:0] };
+				pos = e[8] ? 0 : (pos + 1);
+			end
+		end
+	endfunction
+
+	localparam [31:0] LOCK_SR = lock_sr(LOCK_DATA);
+
+	// Only compare the bits that are actually written
+	localparam [15:0] CHECK_DATA   = LOCK_SR[15:0];
+	localparam [15:0] CHECK_MASK_W = CHECK_MASK & LOCK_SR[31:16];
+
+	localparam CHECK_EN = (CHECK_MASK_W != 16'h0000);
+
+	// Read SR1 and SR2 ( the 00 bytes are used to clock in the response )
+	localparam CHECK_SEQ = {
+		2'b00, 8'h05,	// READ_SR1
+		2'b01, 8'h00,
+		2'b00, 8'h35,	// READ_SR2
+		2'b11, 8'h00
+	};
+
+	localparam CHECK_N = 4;
+	localparam LOCK_N  = CHECK_N + LOCK_BITS / 10;
+
+	localparam [LOCK_N*10-1:0] SEQ_DATA = { CHECK_SEQ, LOCK_DATA };
 
 
 	// Signals
@@ -69,15 +121,21 @@ module flash_lock #(
 	reg        cmd_byte_last;
 	reg        cmd_last;
 
+	// Status read-back
+	reg        check;
+	reg [23:0] rd_shift;
+	wire       check_match;
+
 
 	// Lock sequence ROM
 	// -----------------
 
+	// Check sequence is always there, it's just skipped if unused
 	initial
 	begin : im_mem_init
 		integer i;
 		for (i=0; i<LOCK_N; i=i+1)
-			im_mem[i] <= LOCK_DATA[(LOCK_N-1-i)*10+:10];
+			im_mem[i] <= SEQ_DATA[(LOCK_N-1-i)*10+:10];
 	end
 
 	assign im_rdata = im_mem[im_raddr];
@@ -112,13 +170,18 @@ module flash_lock #(
 				state_nxt = ST_CMD_SHIFT_HI;
 
 			ST_CMD_SHIFT_HI:
-				state_nxt = (bit_last & cmd_byte_last) ?
-					ST_CMD_PAUSE :
-					ST_CMD_SHIFT_LO;
+				// No pause needed after the very last command
+				if (bit_last & cmd_byte_last)
+					state_nxt = (cmd_last & ~check) ? ST_IDLE : ST_CMD_PAUSE;
+				else
+					state_nxt = ST_CMD_SHIFT_LO;
 
 			ST_CMD_PAUSE:
-				if (bit_last)
-					state_nxt = cmd_last ? ST_IDLE : ST_CMD_START;
+				// Done right away if the check matched
+				if (check & cmd_last & check_match)
+					state_nxt = ST_IDLE;
+				else if (bit_last)
+					state_nxt = ST_CMD_START;
 		endcase
 
 	end
@@ -126,6 +189,39 @@ module flash_lock #(
 	assign rdy = (state == ST_IDLE);
 
 
+	// Status check
+	// ------------
+
+	// Are we in the check phase
+	always @(posedge clk)
+		if (rst)
+			check <= 1'b0;
+		else if (state == ST_IDLE)
+			check <= CHECK_EN;
+		else if ((state == ST_CMD_PAUSE) & cmd_last)
+			check <= 1'b0;
+
+	// Sample MISO right before each rising edge, the flash updates it on
+	// the falling ones. We only need the last 24 bits : SR1, READ_SR2
+	// command, SR2
+	always @(posedge clk)
+		if (state == ST_CMD_SHIFT_HI)
+			rd_shift <= { rd_shift[22:0], spi_miso };
+
+	assign check_match = ((
+		{ rd_shift[23:16], rd_shift[7:0] } ^ CHECK_DATA
+	) & CHECK_MASK_W) == 16'h0000;
+
+	// Report if lock was skipped
+	always @(posedge clk)
+		if (rst)
+			skipped <= 1'b0;
+		else if (go)
+			skipped <= 1'b0;
+		else if (check & (state == ST_CMD_PAUSE) & cmd_last)
+			skipped <= check_match;
+
+
 	// Counters
 	// --------
 
@@ -137,7 +233,7 @@ module flash_lock #(
 	// Read address from ROM
 	always @(posedge clk)
 		if (state == ST_IDLE)
-			im_raddr <= 4'h0;
+			im_raddr <= CHECK_EN ? 4'h0 : CHECK_N;
 		else if (cmd_load)
 			im_raddr <= im_raddr + 1;
 
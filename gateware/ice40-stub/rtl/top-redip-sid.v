@@ -182,6 +182,7 @@ module top (
 
 	// SPI command
 	flash_lock #(
+		.CHECK_MASK(`FLASH_LOCK_CHECK_MASK),
 		.LOCK_DATA(`FLASH_LOCK)
 	) flash_lock_I (
 		.spi_mosi (spi_mosi),
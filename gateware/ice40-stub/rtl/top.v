@@ -10,7 +10,10 @@
 `default_nettype none
 `include "boards.vh"
 
-module top (
+module top #(
+	// Skip the flash lock if already applied (see boards.vh)
+	parameter [15:0] LOCK_CHECK_MASK = `FLASH_LOCK_CHECK_MASK
+)(
 	// Special features
 `ifdef MISC_SEL
 	output wire [($bits(`MISC_SEL)/2)-1:0] misc,
@@ -81,7 +84,7 @@ module top (
 	reg  [1:0] boot_sel;
 
 	// Timer/Counter
-	reg  [23:0] timer;
+	reg  [23:0] timer = 24'h000000;
 	wire timer_tick;
 	wire timer_rst;
 
@@ -198,6 +201,7 @@ module top (
 
 	// SPI command
 	flash_lock #(
+		.CHECK_MASK(LOCK_CHECK_MASK),
 		.LOCK_DATA(`FLASH_LOCK)
 	) flash_lock_I (
 		.spi_mosi (spi_mosi),
@@ -206,6 +210,7 @@ module top (
 		.spi_cs_n (spi_cs_n),
 		.go       (fl_go),
 		.rdy      (fl_rdy),
+		.skipped  (),
 		.clk      (clk),
 		.rst      (rst)
 	);
@@ -285,7 +290,7 @@ module top (
 	wire       dim;
 		// Dimming
 `ifdef RGB_DIM
-	reg  [`RGB_DIM:0] dim_cnt;
+	reg  [`RGB_DIM:0] dim_cnt = 0;
 
 	always @(posedge clk)
 		if (dim_cnt[`RGB_DIM])
@@ -365,7 +370,8 @@ module top (
 	// Clock / Reset
 	// -------------
 
-	reg [7:0] cnt_reset;
+	// Hold reset for 128 cycles to let HFOSC settle
+	reg [7:0] cnt_reset = 8'h00;
 
 	SB_HFOSC #(
 		.CLKHF_DIV("0b10")	// 12 MHz
@@ -20,6 +20,16 @@ module flash_lock_tb;
 	reg  go = 1'b0;
 	wire rdy;
 
+	wire split_mosi;
+	wire split_miso;
+	wire split_clk;
+	wire split_cs_n;
+	reg  split_go = 1'b0;
+	wire split_rdy;
+	wire split_skipped;
+
+	integer errors = 0;
+
 
 	// Setup recording
 	// ---------------
@@ -49,4 +59,80 @@ module flash_lock_tb;
 		.rst(rst)
 	);
 
+
+	// Split SR1 / SR2 write
+	// ---------------------
+
+	// For flashes without a combined WRITE_SR, with the lock check : the
+	// compare values must come from both writes
+
+	flash_lock #(
+		.LOCK_DATA({
+			2'b01, 8'h50,	// WRITE_ENABLE_VOLATILE
+			2'b00, 8'h01,	// WRITE_SR1
+			2'b01, 8'h28,	// SR1 value
+			2'b01, 8'h50,	// WRITE_ENABLE_VOLATILE
+			2'b00, 8'h31,	// WRITE_SR2
+			2'b11, 8'h03	// SR2 value
+		}),
+		.CHECK_MASK({ 8'hfc, 8'h43 })
+	) split_I (
+		.spi_mosi (split_mosi),
+		.spi_miso (split_miso),
+		.spi_clk  (split_clk),
+		.spi_cs_n (split_cs_n),
+		.go       (split_go),
+		.rdy      (split_rdy),
+		.skipped  (split_skipped),
+		.clk      (clk),
+		.rst      (rst)
+	);
+
+	spiflash_sr split_flash_I (
+		.spi_mosi (split_mosi),
+		.spi_miso (split_miso),
+		.spi_clk  (split_clk),
+		.spi_cs_n (split_cs_n)
+	);
+
+	task split_run;
+		begin
+			@(posedge clk);
+			split_go <= 1'b1;
+			@(posedge clk);
+			split_go <= 1'b0;
+			@(posedge clk);
+			while (!split_rdy)
+				@(posedge clk);
+		end
+	endtask
+
+	initial
+	begin
+		#5000;
+
+		// Fresh flash : status read, then both writes
+		split_run;
+
+		if (split_skipped || (split_flash_I.n_cmd != 6) || (split_flash_I.n_sr_write != 2) ||
+		    (split_flash_I.sr1 != 8'h28) || (split_flash_I.sr2 != 8'h03)) begin
+			$display("[!] split, fresh : skipped %0d, %0d commands / %0d SR writes, SR1 %02x SR2 %02x",
+				split_skipped, split_flash_I.n_cmd, split_flash_I.n_sr_write,
+				split_flash_I.sr1, split_flash_I.sr2);
+			errors = errors + 1;
+		end
+
+		// Now locked : status read only
+		split_run;
+
+		if (!split_skipped || (split_flash_I.n_cmd != 8) || (split_flash_I.n_sr_write != 2)) begin
+			$display("[!] split, locked : skipped %0d, %0d commands / %0d SR writes",
+				split_skipped, split_flash_I.n_cmd, split_flash_I.n_sr_write);
+			errors = errors + 1;
+		end
+
+		$display("Flash lock test: %0s", errors ? "FAIL" : "PASS");
+		$finish;
+	end
+
 endmodule // flash_lock_tb
@@ -0,0 +1,100 @@
+/*
+ * spiflash_sr.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Minimal SPI flash model, only the status registers :
+ *  - 05h / 35h : Read SR1 / SR2
+ *  - 50h       : Write Enable for Volatile Status Register
+ *  - 01h       : Write SR1 (+ SR2)
+ *  - 31h       : Write SR2
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module spiflash_sr #(
+	parameter [7:0] SR1_INIT = 8'h00,
+	parameter [7:0] SR2_INIT = 8'h00
+)(
+	input  wire spi_mosi,
+	output reg  spi_miso,
+	input  wire spi_clk,
+	input  wire spi_cs_n
+);
+
+	// Signals
+	// -------
+
+	reg  [7:0] sr1 = SR1_INIT;
+	reg  [7:0] sr2 = SR2_INIT;
+	reg        wel = 1'b0;
+
+	reg  [7:0] cmd;
+	reg  [7:0] shift_in;
+	reg  [7:0] shift_out;
+	reg  [7:0] wr_data[0:1];
+	integer    bit_cnt;
+
+	// Stats
+	integer    n_cmd = 0;
+	integer    n_sr_write = 0;
+
+
+	// Model
+	// -----
+
+	initial
+		spi_miso = 1'b0;
+
+	always @(negedge spi_cs_n)
+		bit_cnt = 0;
+
+	always @(posedge spi_clk)
+		if (~spi_cs_n) begin
+			shift_in = { shift_in[6:0], spi_mosi };
+			bit_cnt  = bit_cnt + 1;
+
+			if (bit_cnt == 8) begin
+				cmd = shift_in;
+				case (cmd)
+					8'h05:   shift_out = sr1;
+					8'h35:   shift_out = sr2;
+					default: shift_out = 8'h00;
+				endcase
+			end else if ((bit_cnt == 16) || (bit_cnt == 24)) begin
+				wr_data[(bit_cnt >> 3) - 2] = shift_in;
+			end
+		end
+
+	always @(negedge spi_clk)
+		if (~spi_cs_n & (bit_cnt >= 8)) begin
+			spi_miso  <= shift_out[7];
+			shift_out <= { shift_out[6:0], 1'b0 };
+		end
+
+	always @(posedge spi_cs_n)
+	begin
+		n_cmd = n_cmd + 1;
+
+		if ((cmd == 8'h50) && (bit_cnt == 8))
+			wel = 1'b1;
+
+		if ((cmd == 8'h01) && (bit_cnt >= 16) && wel) begin
+			sr1 = wr_data[0];
+			if (bit_cnt >= 24)
+				sr2 = wr_data[1];
+			wel = 1'b0;
+			n_sr_write = n_sr_write + 1;
+		end
+
+		if ((cmd == 8'h31) && (bit_cnt >= 16) && wel) begin
+			sr2 = wr_data[0];
+			wel = 1'b0;
+			n_sr_write = n_sr_write + 1;
+		end
+	end
+
+endmodule // spiflash_sr
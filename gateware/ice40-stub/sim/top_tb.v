@@ -0,0 +1,184 @@
+/*
+ * top_tb.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Measures the duration of each phase between the stub coming out of
+ * configuration and the warmboot trigger, both with the flash status
+ * registers in their default state (cold boot) and already holding the
+ * lock values (warm restart). Each one is done with the lock check of the
+ * board (on for the W25Q ones, see boards.vh) and with it forced on.
+ *
+ * Also checks that every run ends with the flash locked, App 1 selected,
+ * only the expected SPI commands and the warmboot right after the last
+ * one.
+ *
+ * All counts are in 12 MHz HFOSC cycles. The totals of the board config
+ * are also reported as BENCH lines for utils/bench.py (see `make bench`).
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+`include "boards.vh"
+
+module top_tb;
+
+	// Lock sequence, all boards end it with a WRITE_SR of both SR1 / SR2
+	// (see boards.vh, split writes are covered by flash_lock_tb)
+	localparam LOCK = `FLASH_LOCK;
+	localparam [7:0] LOCK_SR1 = LOCK[17:10];
+	localparam [7:0] LOCK_SR2 = LOCK[7:0];
+
+	// W25Q writable protection bits
+	localparam [15:0] CHECK_MASK = `FLASH_LOCK_CHECK_W25Q;
+
+
+	// Signals
+	// -------
+
+	reg clk = 1'b0;
+	integer cyc = 0;
+	integer errors = 0;
+
+
+	// Setup recording
+	// ---------------
+
+	initial begin
+		$dumpfile("top_tb.vcd");
+		$dumpvars(0,top_tb);
+		# 2000000 $finish;
+	end
+
+	always #41.667 clk <= !clk;
+
+	always @(posedge clk)
+		cyc <= cyc + 1;
+
+
+	// DUTs
+	// ----
+	// bit 0 : flash already locked, bit 1 : lock check forced on
+
+	genvar i;
+	generate
+		for (i=0; i<4; i=i+1)
+		begin : run
+
+			localparam LOCKED = i & 1;
+			localparam CHECK  = (i & 2) ? 1 : (`FLASH_LOCK_CHECK_MASK != 16'h0000);
+
+			wire spi_mosi;
+			wire spi_miso;
+			wire spi_clk;
+			wire spi_cs_n;
+
+			integer t_rst;
+			integer t_lock;
+			integer t_cs = 0;
+			integer t_boot = 0;
+			integer n_cmd_exp;
+			integer n_wr_exp;
+
+			// Flash, either fresh or already locked
+			spiflash_sr #(
+				.SR1_INIT(LOCKED ? LOCK_SR1 : 8'h00),
+				.SR2_INIT(LOCKED ? LOCK_SR2 : 8'h00)
+			) flash_I (
+				.spi_mosi (spi_mosi),
+				.spi_miso (spi_miso),
+				.spi_clk  (spi_clk),
+				.spi_cs_n (spi_cs_n)
+			);
+
+			// Stub (button not pressed)
+			top #(
+				.LOCK_CHECK_MASK((i & 2) ? CHECK_MASK : `FLASH_LOCK_CHECK_MASK)
+			) dut_I (
+				.btn      (1'b1),
+				.spi_mosi (spi_mosi),
+				.spi_miso (spi_miso),
+				.spi_clk  (spi_clk),
+				.spi_cs_n (spi_cs_n)
+			);
+
+			// No HFOSC model, feed the clock directly. Also the glitch
+			// filter has no power-on state in simulation, so briefly
+			// reset it.
+			initial begin
+				force dut_I.clk = clk;
+				force dut_I.btn_flt_I.rst = 1'b1;
+				#200 release dut_I.btn_flt_I.rst;
+			end
+
+			// Phases
+			always @(negedge dut_I.rst)
+				t_rst = cyc;
+
+			always @(posedge dut_I.fl_go)
+				t_lock = cyc;
+
+			always @(posedge spi_cs_n)
+				t_cs = cyc;
+
+			always @(posedge dut_I.boot_now_r)
+			begin
+				t_boot = cyc;
+				$display("[%s, check %0s] reset: %0d, to lock start: %0d, lock: %0d, total: %0d cycles (%0d SPI commands, %0d SR writes)",
+					LOCKED ? "locked" : "fresh ",
+					CHECK ? "on " : "off",
+					t_rst, t_lock - t_rst, t_boot - t_lock, t_boot,
+					flash_I.n_cmd, flash_I.n_sr_write
+				);
+				if (!(i & 2))
+					$display("BENCH stub.warmboot_%0s_us %0d lower",
+						LOCKED ? "locked" : "fresh", t_boot / 12
+					);
+
+				// Check reads only when enabled, lock write unless skipped
+				n_cmd_exp = (CHECK ? 2 : 0) + ((CHECK && LOCKED) ? 0 : 2);
+				n_wr_exp  = (CHECK && LOCKED) ? 0 : 1;
+
+				if ((flash_I.n_cmd != n_cmd_exp) || (flash_I.n_sr_write != n_wr_exp)) begin
+					$display("[!] run %0d : %0d commands / %0d SR writes, expected %0d / %0d",
+						i, flash_I.n_cmd, flash_I.n_sr_write, n_cmd_exp, n_wr_exp);
+					errors = errors + 1;
+				end
+
+				if ((flash_I.sr1 != LOCK_SR1) || (flash_I.sr2 != LOCK_SR2)) begin
+					$display("[!] run %0d : flash not locked (SR1 %02x SR2 %02x)", i, flash_I.sr1, flash_I.sr2);
+					errors = errors + 1;
+				end
+
+				if (dut_I.boot_sel != 2'b10) begin
+					$display("[!] run %0d : booting image %0d instead of App 1", i, dut_I.boot_sel);
+					errors = errors + 1;
+				end
+
+				// Boot as soon as the flash is released
+				if ((t_boot - t_cs) > 3) begin
+					$display("[!] run %0d : warmboot %0d cycles after the last SPI command", i, t_boot - t_cs);
+					errors = errors + 1;
+				end
+			end
+
+		end
+	endgenerate
+
+	// Results
+	initial
+	begin
+		#1000000;
+
+		if (!run[0].t_boot || !run[1].t_boot || !run[2].t_boot || !run[3].t_boot) begin
+			$display("[!] Not all runs reached warmboot");
+			errors = errors + 1;
+		end
+
+		$display("Stub boot test: %0s", errors ? "FAIL" : "PASS");
+		$finish;
+	end
+
+endmodule // top_tb
@@ -6,7 +6,9 @@
 # SPDX-License-Identifier: MIT
 #
 
+import struct
 import sys
+import zlib
 
 """
 0       0x000000    Multiboot header
@@ -21,10 +23,21 @@ import sys
 
 768k    0x0c0000    App 2 FPGA Image
 896k    0x0e0000    App 2 Software Image
+
+App 1 / App 2 can also be used as A/B slots for the same application by
+pointing the boot address of image 2 to either of them (see
+utils/ab_update.py)
+
+Additional data can be placed anywhere after that with `-d offset:file`
+(before the output file name), including above 16M on large flashes.
+Bitstreams can't : the iCE40 warmboot boot address is only 24 bits.
 """
 
 
 def hdr(mode, offset):
+	if offset >= (1 << 24):
+		raise ValueError('iCE40 boot addresses are limited to 16M')
+
 	return bytes([
 		# Sync header
 		0x7e, 0xaa, 0x99, 0x7e,
@@ -76,25 +89,79 @@ def load_image(img_name):
 	return bs, fw
 
 
-def main(argv0, out, *images):
+"""
+Sparse image format (all fields little endian) :
+
+  Header  : magic 'no2S' (4), version (u16), segment count (u16),
+            dense image size (u32), CRC32 of the segment table (u32)
+  Table   : offset (u32), length (u32), CRC32 of the data (u32)  x  count
+  Data    : segments payload, concatenated in table order
+"""
+
+SPARSE_MAGIC   = b'no2S'
+SPARSE_VERSION = 1
+
+
+def build_sparse(segments):
+	table = b''.join([struct.pack('<III', o, len(d), zlib.crc32(d)) for o, d in segments])
+	size  = max([o + len(d) for o, d in segments])
+	return b''.join(
+		[ struct.pack('<4sHHII', SPARSE_MAGIC, SPARSE_VERSION, len(segments), size, zlib.crc32(table)), table ] +
+		[ d for o, d in segments ]
+	)
+
+
+def build_dense(segments):
+	data = bytearray()
+	for o, d in segments:
+		data[len(data):] = bytearray(o + len(d) - len(data))
+		data[o:o+len(d)] = d
+	return data
+
+
+def main(argv0, *args):
+	# Options
+	sparse = False
+	data = []
+
+	while len(args) and args[0].startswith('-'):
+		if args[0] == '-s':
+			sparse = True
+			args = args[1:]
+		elif args[0] == '-d':
+			o, fn = args[1].split(':', 1)
+			data.append( (int(o, 0), open(fn, 'rb').read()) )
+			args = args[2:]
+		else:
+			raise ValueError(f'Unknown option {args[0]}')
+
+	out, images = args[0], args[1:]
+
 	# Build the header
 	mb_hdr = b''.join([hdr(m, o0) for m,o0,o1 in offset_map])
 
 	# Load images (if any)
 	images = [load_image(i) for i in images]
 
-	# Build final image
-	data = bytearray(mb_hdr)
+	# Collect all populated segments
+	segments = [ (0, mb_hdr) ]
 
 	for (_, o_bs, o_fw), (d_bs, d_fw) in zip(offset_map[1:], images):
 		for o, d in [(o_bs, d_bs), (o_fw, d_fw)]:
 			if len(d):
-				data[len(data):] = bytearray(o + len(d) - len(data))
-				data[o:o+len(d)] = d
+				segments.append( (o, d) )
+
+	# Extra data
+	segments.extend(data)
+	segments.sort()
+
+	for (o0, d0), (o1, d1) in zip(segments[:-1], segments[1:]):
+		if o0 + len(d0) > o1:
+			raise ValueError(f'Overlapping data @0x{o1:08x}')
 
 	# Write final image
 	with open(out, 'wb') as fh:
-		fh.write( data )
+		fh.write( build_sparse(segments) if sparse else build_dense(segments) )
 
 
 if __name__ == '__main__':
@@ -0,0 +1,97 @@
+/*
+ * boot_trace.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Boot milestones timestamping
+ *
+ * Free running timestamp counter started when the logic comes out of
+ * reset (i.e. right after PLL lock) and N capture registers that latch
+ * it the first time software marks the matching milestone.
+ *
+ * Register map (word addresses) :
+ *   2       R: Current timestamp    W: Mark milestone wdata[2:0]
+ *   8-15    R: Milestone timestamps ([31] = valid)
+ *
+ * Milestone 0 is marked by hardware on the first cycle out of reset.
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module boot_trace (
+	// Bus interface
+	input  wire  [3:0] bus_addr,
+	input  wire [31:0] bus_wdata,
+	output reg  [31:0] bus_rdata,
+	input  wire        bus_we,
+	input  wire        bus_cyc,
+
+	// Clock / Reset
+	input  wire clk,
+	input  wire rst
+);
+
+	integer i;
+
+
+	// Signals
+	// -------
+
+	reg  [30:0] ts;
+	reg  [31:0] ms[0:7];
+	reg         ms0_done;
+
+	wire        mark_stb;
+	wire  [2:0] mark_id;
+
+
+	// Timestamp
+	// ---------
+
+	always @(posedge clk or posedge rst)
+		if (rst)
+			ts <= 0;
+		else
+			ts <= ts + 1;
+
+
+	// Milestones
+	// ----------
+
+	assign mark_stb = bus_cyc & bus_we & (bus_addr == 4'h2);
+	assign mark_id  = bus_wdata[2:0];
+
+	always @(posedge clk or posedge rst)
+		if (rst)
+			ms0_done <= 1'b0;
+		else
+			ms0_done <= 1'b1;
+
+	always @(posedge clk or posedge rst)
+		if (rst) begin
+			for (i=0; i<8; i=i+1)
+				ms[i] <= 32'h00000000;
+		end else begin
+			for (i=0; i<8; i=i+1)
+				if (~ms[i][31] & ((i == 0) ? ~ms0_done : (mark_stb & (mark_id == i))))
+					ms[i] <= { 1'b1, ts };
+		end
+
+
+	// Read mux
+	// --------
+
+	always @(*)
+		if (~bus_cyc)
+			bus_rdata = 32'h00000000;
+		else if (bus_addr[3])
+			bus_rdata = ms[bus_addr[2:0]];
+		else if (bus_addr == 4'h2)
+			bus_rdata = { 1'b0, ts };
+		else
+			bus_rdata = 32'h00000000;
+
+endmodule // boot_trace
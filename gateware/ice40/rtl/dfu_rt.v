@@ -0,0 +1,95 @@
+/*
+ * dfu_rt.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * DFU runtime support for user applications
+ *
+ * dfu_helper in application mode (long press reboots to the bootloader,
+ * short press requests a reset) with a register so the firmware can also
+ * warmboot on its own, typically when its DFU runtime interface gets a
+ * DFU_DETACH request.
+ *
+ * Register map (word addresses) :
+ *   0       R: [0] Button state, [1] Reset requested by short press
+ *           W: [2] Boot now, [1:0] Image select (1 = bootloader)
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module dfu_rt #(
+	parameter integer TIMER_WIDTH = 24,
+	parameter integer BTN_MODE = 3
+)(
+	// Bus interface
+	input  wire  [3:0] bus_addr,
+	input  wire [31:0] bus_wdata,
+	output reg  [31:0] bus_rdata,
+	input  wire        bus_we,
+	input  wire        bus_cyc,
+
+	// Button
+	input  wire btn_pad,
+	input  wire btn_tick,
+
+	// Outputs
+	output wire btn_val,
+	output wire rst_req,
+
+	// Clock / Reset
+	input  wire clk,
+	input  wire rst
+);
+
+	// Signals
+	// -------
+
+	reg       boot_now;
+	reg [1:0] boot_sel;
+
+
+	// Boot register
+	// -------------
+
+	always @(posedge clk or posedge rst)
+		if (rst) begin
+			boot_now <= 1'b0;
+			boot_sel <= 2'b00;
+		end else if (bus_cyc & bus_we & (bus_addr == 4'h0)) begin
+			boot_now <= bus_wdata[2];
+			boot_sel <= bus_wdata[1:0];
+		end
+
+
+	// Helper
+	// ------
+
+	dfu_helper #(
+		.TIMER_WIDTH(TIMER_WIDTH),
+		.BTN_MODE(BTN_MODE),
+		.DFU_MODE(0)
+	) helper_I (
+		.boot_sel (boot_sel),
+		.boot_now (boot_now),
+		.btn_pad  (btn_pad),
+		.btn_tick (btn_tick),
+		.btn_val  (btn_val),
+		.rst_req  (rst_req),
+		.clk      (clk),
+		.rst      (rst)
+	);
+
+
+	// Read mux
+	// --------
+
+	always @(*)
+		if (bus_cyc & (bus_addr == 4'h0))
+			bus_rdata = { 30'h00000000, rst_req, btn_val };
+		else
+			bus_rdata = 32'h00000000;
+
+endmodule // dfu_rt
@@ -0,0 +1,299 @@
+/*
+ * spi_stream_wb.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Shim in front of the SB_SPI wishbone wrapper that lets the CPU push
+ * 32 bits words of TX data and handles the per-byte TXDR / RRDY / RXDR
+ * sequence in hardware.
+ *
+ * It also has a busy poller : once started (after an erase or program
+ * command), it reads the flash status register (05h) on its own at the
+ * given interval until the busy bit clears, so the CPU only has to check
+ * a local register.
+ *
+ * Register map (word addresses) :
+ *   0x00-0x0f  SB_SPI registers (pass-through)
+ *   0x10       W: Push 4 TX bytes (LSB first, i.e. memory order)
+ *              R: Returns 0 once all pushed bytes are sent
+ *   0x11       W: [31] Start busy polling, [17:16] CS, [15:0] Interval (clk)
+ *              R: [31] Polling, [8] Done (flash seen idle), [7:0] Last SR1
+ *
+ * Any access is stalled until previously pushed bytes are sent, so the CPU
+ * can mix both freely (e.g. release CS right after the last push).
+ *
+ * Any access except a read of 0x11 also stops the poller (after the status
+ * read in progress, if any) and clears 'Done', so the CPU can use the SPI
+ * any time without caring about it.
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module spi_stream_wb (
+	// Slave (CPU side)
+	input  wire  [4:0] s_addr,
+	output wire [31:0] s_rdata,
+	input  wire [31:0] s_wdata,
+	input  wire        s_we,
+	input  wire        s_cyc,
+	output wire        s_ack,
+
+	// Master (SB_SPI wrapper side)
+	output wire  [3:0] m_addr,
+	input  wire [31:0] m_rdata,
+	output wire [31:0] m_wdata,
+	output wire        m_we,
+	output wire        m_cyc,
+	input  wire        m_ack,
+
+	// Clock / Reset
+	input  wire clk,
+	input  wire rst
+);
+
+	localparam
+		ST_IDLE = 0,
+		ST_TX   = 1,
+		ST_POLL = 2,
+		ST_RX   = 3,
+		ST_GAP  = 4;
+
+	localparam
+		PS_IDLE  = 0,
+		PS_CS_LO = 1,
+		PS_XFER  = 2,
+		PS_CS_HI = 3,
+		PS_WAIT  = 4;
+
+	localparam [3:0]
+		REG_SR   = 4'hc,
+		REG_TXDR = 4'hd,
+		REG_RXDR = 4'he,
+		REG_CSR  = 4'hf;
+
+
+	// Signals
+	// -------
+
+	// FSM
+	reg  [2:0] state;
+	reg  [2:0] state_ret;
+
+	// Data
+	reg [31:0] data;
+	reg  [2:0] cnt;
+
+	wire       busy;
+
+	// Busy poller
+	reg  [2:0] pstate;
+	reg  [1:0] p_cs;
+	reg [15:0] p_ival;
+	reg [15:0] p_timer;
+	reg  [7:0] p_sr;
+	reg        p_done;
+	reg        p_stop;
+
+	wire       p_busy;
+	wire       p_start;
+
+	// Bus
+	wire       s_poll_rd;
+	wire       s_spi;
+
+	wire       e_cyc;
+	reg  [3:0] e_addr;
+	reg [31:0] e_wdata;
+	wire       e_we;
+
+	reg        reg_ack;
+
+
+	// Engine
+	// ------
+
+	assign busy = (state != ST_IDLE) | (cnt != 3'd0) | p_busy;
+
+	always @(posedge clk or posedge rst)
+		if (rst)
+			state <= ST_IDLE;
+		else
+			case (state)
+				ST_IDLE:
+					if (cnt != 3'd0)
+						state <= ST_TX;
+
+				ST_TX:
+					if (m_ack)
+						state <= ST_GAP;
+
+				ST_POLL:
+					if (m_ack)
+						state <= ST_GAP;
+
+				ST_RX:
+					if (m_ack)
+						state <= ST_GAP;
+
+				ST_GAP:
+					state <= state_ret;
+			endcase
+
+	// Where to go after the gap cycle
+	always @(posedge clk)
+		if (m_ack)
+			case (state)
+				ST_TX:   state_ret <= ST_POLL;
+				ST_POLL: state_ret <= m_rdata[3] ? ST_RX : ST_POLL;	// RRDY
+				ST_RX:   state_ret <= ST_IDLE;
+				default: state_ret <= ST_IDLE;
+			endcase
+
+	// Data
+	always @(posedge clk or posedge rst)
+		if (rst) begin
+			data <= 32'h00000000;
+			cnt  <= 3'd0;
+		end else if (s_cyc & s_we & (s_addr == 5'h10) & ~busy & ~reg_ack) begin
+			data <= s_wdata;
+			cnt  <= 3'd4;
+		end else if ((pstate == PS_CS_LO) & m_ack) begin
+			data <= 32'h00000005;
+			cnt  <= 3'd2;
+		end else if ((state == ST_RX) & m_ack) begin
+			data <= { 8'h00, data[31:8] };
+			cnt  <= cnt - 1;
+		end
+
+
+
+	// Busy poller
+	// -----------
+
+	// CPU accesses
+	assign s_poll_rd = s_cyc & ~s_we & (s_addr == 5'h11);
+	assign s_spi     = s_cyc & ~s_poll_rd & ~reg_ack;
+
+	assign p_start = s_cyc & s_we & (s_addr == 5'h11) & ~busy & ~reg_ack & s_wdata[31];
+	assign p_busy  = (pstate != PS_IDLE);
+
+	// FSM : CS low, 05h + 1 byte through the byte engine, CS high, wait
+	always @(posedge clk or posedge rst)
+		if (rst)
+			pstate <= PS_IDLE;
+		else
+			case (pstate)
+				PS_IDLE:
+					if (p_start)
+						pstate <= PS_CS_LO;
+
+				PS_CS_LO:
+					if (m_ack)
+						pstate <= PS_XFER;
+
+				PS_XFER:
+					if ((state == ST_IDLE) & (cnt == 3'd0))
+						pstate <= PS_CS_HI;
+
+				PS_CS_HI:
+					if (m_ack)
+						pstate <= (p_stop | ~p_sr[0]) ? PS_IDLE : PS_WAIT;
+
+				PS_WAIT:
+					if (p_stop)
+						pstate <= PS_IDLE;
+					else if (p_timer == 16'h0000)
+						pstate <= PS_CS_LO;
+
+				default:
+					pstate <= PS_IDLE;
+			endcase
+
+	// Config
+	always @(posedge clk)
+		if (p_start) begin
+			p_cs   <= s_wdata[17:16];
+			p_ival <= s_wdata[15:0];
+		end
+
+	always @(posedge clk)
+		if ((pstate == PS_CS_HI) & m_ack)
+			p_timer <= p_ival;
+		else if (p_timer != 16'h0000)
+			p_timer <= p_timer - 1;
+
+	// Status (last byte received is SR1)
+	always @(posedge clk or posedge rst)
+		if (rst)
+			p_sr <= 8'h00;
+		else if ((pstate == PS_XFER) & (state == ST_RX) & m_ack)
+			p_sr <= m_rdata[7:0];
+
+	always @(posedge clk or posedge rst)
+		if (rst)
+			p_done <= 1'b0;
+		else if (s_spi)
+			p_done <= 1'b0;
+		else if ((pstate == PS_CS_HI) & m_ack & ~p_sr[0])
+			p_done <= 1'b1;
+
+	// Stop request from any CPU access
+	always @(posedge clk or posedge rst)
+		if (rst)
+			p_stop <= 1'b0;
+		else
+			p_stop <= p_busy & (p_stop | s_spi);
+
+
+	// Bus requests
+	// ------------
+
+	assign e_cyc = (state == ST_TX) | (state == ST_POLL) | (state == ST_RX) |
+	               (pstate == PS_CS_LO) | (pstate == PS_CS_HI);
+	assign e_we  = (state == ST_TX) | (pstate == PS_CS_LO) | (pstate == PS_CS_HI);
+
+	always @(*)
+		if ((pstate == PS_CS_LO) | (pstate == PS_CS_HI))
+			e_addr = REG_CSR;
+		else
+			case (state)
+				ST_TX:   e_addr = REG_TXDR;
+				ST_RX:   e_addr = REG_RXDR;
+				default: e_addr = REG_SR;
+			endcase
+
+	always @(*)
+		case (pstate)
+			PS_CS_LO: e_wdata = { 28'h0000000, 4'hf ^ (4'h1 << p_cs) };
+			PS_CS_HI: e_wdata = 32'h0000000f;
+			default:  e_wdata = { 24'h000000, data[7:0] };
+		endcase
+
+
+	// Bus muxing
+	// ----------
+
+	// Master
+	assign m_addr  = busy ? e_addr : s_addr[3:0];
+	assign m_wdata = busy ? e_wdata : s_wdata;
+	assign m_we    = busy ? e_we : s_we;
+	assign m_cyc   = busy ? e_cyc : (s_cyc & ~s_addr[4]);
+
+	// Local registers (poller status reads don't wait)
+	always @(posedge clk or posedge rst)
+		if (rst)
+			reg_ack <= 1'b0;
+		else
+			reg_ack <= s_cyc & s_addr[4] & (~busy | s_poll_rd) & ~reg_ack;
+
+	// Slave (read data must be zero when not acking, the engine uses
+	// the master bus in the background)
+	assign s_ack   = s_addr[4] ? reg_ack : (m_ack & ~busy);
+	assign s_rdata = s_addr[4] ?
+		((reg_ack & (s_addr == 5'h11)) ? { p_busy, 22'h000000, p_done, p_sr } : 32'h00000000) :
+		((m_ack & ~busy) ? m_rdata : 32'h00000000);
+
+endmodule // spi_stream_wb
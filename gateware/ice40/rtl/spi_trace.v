@@ -0,0 +1,222 @@
+/*
+ * spi_trace.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * SPI flash traffic capture
+ *
+ * Snoops the register bus of the SB_SPI wrapper (i.e. whatever drives it,
+ * CPU, TX stream or busy poller) and records CS changes and bytes with
+ * their timing into a BRAM, for profiling.
+ *
+ * The SPI pads are inside the IOB so they can't be observed directly. A
+ * byte starts with its TXDR write and ends with the RXDR read of its
+ * result, which all the SPI code does for every byte. The end time is
+ * thus slightly late (RRDY polling) but that's also when the next byte
+ * could start at the earliest.
+ *
+ * Entries (32 bits) :
+ *   CS   : [31] 0, [27:24] CSR value, [23:0] cycles since previous entry
+ *   Byte : [31] 1, [30:23] TX data, [22:11] cycles since previous entry
+ *          until TXDR write, [10:0] cycles from TXDR write to RXDR read
+ *
+ * All counts saturate. 'Previous entry' is its CSR write or RXDR read.
+ * A TXDR write with no RXDR read before the next CSR write is dropped.
+ *
+ * Register map (word addresses) :
+ *   0       R: [31] Present, [30] Full (wrapped), [23:16] AW,
+ *              [2] One-shot, [1] Enabled
+ *           W: [2] One-shot (stop when full), [1] Enable, [0] Clear
+ *   1       R: Write pointer
+ *   2       R: Cycles elapsed while capturing since clear
+ *   2^AW+   R: Entries
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module spi_trace #(
+	parameter integer AW = 10
+)(
+	// Bus interface
+	input  wire [AW:0] wb_addr,
+	output wire [31:0] wb_rdata,
+	input  wire [31:0] wb_wdata,
+	input  wire        wb_we,
+	input  wire        wb_cyc,
+	output wire        wb_ack,
+
+	// SPI register bus (snoop)
+	input  wire  [3:0] spi_addr,
+	input  wire [31:0] spi_wdata,
+	input  wire        spi_we,
+	input  wire        spi_cyc,
+	input  wire        spi_ack,
+
+	// Clock / Reset
+	input  wire clk,
+	input  wire rst
+);
+
+	localparam [7:0] AW_R = AW;
+
+	localparam [3:0]
+		REG_TXDR = 4'hd,
+		REG_RXDR = 4'he,
+		REG_CSR  = 4'hf;
+
+
+	// Signals
+	// -------
+
+	// Control
+	reg          ena;
+	reg          oneshot;
+	reg          full;
+	reg          clr;
+	wire         run;
+
+	// Events
+	wire         ev_cs;
+	wire         ev_tx;
+	wire         ev_rx;
+
+	reg   [23:0] gap;
+	reg          tx_pend;
+	reg    [7:0] tx_data;
+	reg   [11:0] tx_gap;
+	reg   [10:0] tx_dur;
+
+	// Capture
+	reg   [31:0] time_cnt;
+	reg [AW-1:0] wptr;
+	reg   [31:0] mem[0:(1<<AW)-1];
+	reg   [31:0] mem_wdata;
+	wire         mem_we;
+	reg   [31:0] mem_rdata;
+
+	// Bus
+	reg          ack_i;
+	wire         csr_wr;
+	reg   [31:0] reg_rdata;
+
+
+	// Control
+	// -------
+
+	assign csr_wr = wb_cyc & wb_we & ~ack_i & ~wb_addr[AW] & (wb_addr[1:0] == 2'b00);
+
+	always @(posedge clk or posedge rst)
+		if (rst) begin
+			ena     <= 1'b0;
+			oneshot <= 1'b0;
+			clr     <= 1'b0;
+		end else begin
+			ena     <= csr_wr ? wb_wdata[1] : ena;
+			oneshot <= csr_wr ? wb_wdata[2] : oneshot;
+			clr     <= csr_wr & wb_wdata[0];
+		end
+
+	assign run = ena & ~(oneshot & full);
+
+
+	// Events
+	// ------
+
+	assign ev_cs = spi_cyc & spi_ack &  spi_we & (spi_addr == REG_CSR);
+	assign ev_tx = spi_cyc & spi_ack &  spi_we & (spi_addr == REG_TXDR);
+	assign ev_rx = spi_cyc & spi_ack & ~spi_we & (spi_addr == REG_RXDR);
+
+	// Time since the previous entry
+	always @(posedge clk or posedge rst)
+		if (rst)
+			gap <= 0;
+		else if (clr)
+			gap <= 0;
+		else if (mem_we)
+			gap <= 1;
+		else if (run & ~&gap)
+			gap <= gap + 1;
+
+	// Byte in progress
+	always @(posedge clk or posedge rst)
+		if (rst)
+			tx_pend <= 1'b0;
+		else if (clr | ev_cs)
+			tx_pend <= 1'b0;
+		else if (ev_tx)
+			tx_pend <= run;
+		else if (ev_rx)
+			tx_pend <= 1'b0;
+
+	always @(posedge clk)
+		if (ev_tx) begin
+			tx_data <= spi_wdata[7:0];
+			tx_gap  <= |gap[23:12] ? 12'hfff : gap[11:0];
+			tx_dur  <= 1;
+		end else if (~&tx_dur) begin
+			tx_dur  <= tx_dur + 1;
+		end
+
+
+	// Capture
+	// -------
+
+	assign mem_we = run & (ev_cs | (ev_rx & tx_pend));
+
+	always @(*)
+		if (ev_cs)
+			mem_wdata = { 4'b0000, spi_wdata[3:0], gap };
+		else
+			mem_wdata = { 1'b1, tx_data, tx_gap, tx_dur };
+
+	always @(posedge clk)
+		if (mem_we)
+			mem[wptr] <= mem_wdata;
+
+	always @(posedge clk)
+		mem_rdata <= mem[wb_addr[AW-1:0]];
+
+	always @(posedge clk or posedge rst)
+		if (rst) begin
+			wptr <= 0;
+			full <= 1'b0;
+		end else if (clr) begin
+			wptr <= 0;
+			full <= 1'b0;
+		end else if (mem_we) begin
+			wptr <= wptr + 1;
+			full <= full | &wptr;
+		end
+
+	always @(posedge clk)
+		if (clr)
+			time_cnt <= 0;
+		else if (run)
+			time_cnt <= time_cnt + 1;
+
+
+	// Bus interface
+	// -------------
+
+	always @(posedge clk or posedge rst)
+		if (rst)
+			ack_i <= 1'b0;
+		else
+			ack_i <= wb_cyc & ~ack_i;
+
+	assign wb_ack = ack_i;
+
+	always @(*)
+		case (wb_addr[1:0])
+			2'b00:   reg_rdata = { 1'b1, full, 6'd0, AW_R, 13'd0, oneshot, ena, 1'b0 };
+			2'b01:   reg_rdata = { {(32-AW){1'b0}}, wptr };
+			2'b10:   reg_rdata = time_cnt;
+			default: reg_rdata = 32'h00000000;
+		endcase
+
+	assign wb_rdata = ~ack_i ? 32'h00000000 : (wb_addr[AW] ? mem_rdata : reg_rdata);
+
+endmodule // spi_trace
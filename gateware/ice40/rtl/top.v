@@ -50,12 +50,16 @@ module top (
 	inout  wire spi_cs_n
 );
 
-	localparam WB_N  =  6;
+	localparam WB_N  =  7;
 	localparam WB_DW = 32;
 	localparam WB_AW = 16;
 	localparam WB_AI =  2;
 
+`ifdef SPRAM128K
+	localparam SPRAM_AW = 15; /* 14 => 64k, 15 => 128k */
+`else
 	localparam SPRAM_AW = 14; /* 14 => 64k, 15 => 128k */
+`endif
 
 	genvar i;
 
@@ -98,6 +102,14 @@ module top (
 
 	wire [(WB_DW*WB_N)-1:0] wb_rdata_flat;
 
+	// SPI
+	wire  [3:0] spi_addr;
+	wire [31:0] spi_rdata;
+	wire [31:0] spi_wdata;
+	wire        spi_we;
+	wire        spi_cyc;
+	wire        spi_ack;
+
 	// USB Core
 		// EP Buffer
 	wire [ 8:0] ep_tx_addr_0;
@@ -116,6 +128,12 @@ module top (
 	wire        ub_we;
 	wire        ub_ack;
 
+	// Misc
+	wire [31:0] trace_rdata;
+`ifdef ENABLE_UART
+	reg  [19:0] uart_tx_idle;
+`endif
+
 	// WarmBoot
 	reg         boot_now;
 	reg   [1:0] boot_sel;
@@ -199,7 +217,11 @@ module top (
 
 	// Boot memory
 	soc_bram #(
+`ifdef BOOTROM_PLACEHOLDER
+		.INIT_FILE("boot_placeholder.hex")
+`else
 		.INIT_FILE("boot.hex")
+`endif
 	) bram_I (
 		.addr  (bram_addr),
 		.rdata (bram_rdata),
@@ -226,14 +248,13 @@ module top (
 	// ----
 
 	// Bus interface
-	assign wb_rdata[0] = 0;
 	assign wb_ack[0] = wb_cyc[0];
 
 	always @(posedge clk_24m or posedge rst)
 		if (rst) begin
 			boot_now <= 1'b0;
 			boot_sel <= 2'b00;
-		end else if (wb_cyc[0] & wb_we & (wb_addr[2:0] == 3'b000)) begin
+		end else if (wb_cyc[0] & wb_we & (wb_addr[3:0] == 4'h0)) begin
 			boot_now <= wb_wdata[2];
 			boot_sel <= wb_wdata[1:0];
 		end
@@ -243,12 +264,39 @@ module top (
 			led_ena <= 1'b0;
 			led_off <= 0;
 			led_on  <= 0;
-		end else if (wb_cyc[0] & wb_we & (wb_addr[2:0] == 3'b001)) begin
+		end else if (wb_cyc[0] & wb_we & (wb_addr[3:0] == 4'h1)) begin
 			led_ena <= wb_wdata[31];
 			led_off <= wb_wdata[26:16];
 			led_on  <= wb_wdata[10: 0];
 		end
 
+	// Boot milestones
+	boot_trace trace_I (
+		.bus_addr  (wb_addr[3:0]),
+		.bus_wdata (wb_wdata),
+		.bus_rdata (trace_rdata),
+		.bus_we    (wb_we),
+		.bus_cyc   (wb_cyc[0]),
+		.clk       (clk_24m),
+		.rst       (rst)
+	);
+
+`ifdef ENABLE_UART
+	// UART TX idle time (cycles since the last TX write or low level on the
+	// line, saturating), so the firmware can tell when everything is sent
+	always @(posedge clk_24m or posedge rst)
+		if (rst)
+			uart_tx_idle <= 0;
+		else if ((wb_cyc[1] & wb_we & (wb_addr[1:0] == 2'b00)) | ~uart_tx)
+			uart_tx_idle <= 0;
+		else if (~uart_tx_idle[19])
+			uart_tx_idle <= uart_tx_idle + 1;
+
+	assign wb_rdata[0] = trace_rdata | ((wb_cyc[0] & (wb_addr[3:0] == 4'h3)) ? { 12'h000, uart_tx_idle } : 32'h00000000);
+`else
+	assign wb_rdata[0] = trace_rdata;
+`endif
+
 	// Helper
 	dfu_helper #(
 		.TIMER_WIDTH(24),
@@ -307,6 +355,25 @@ module top (
 	// SPI [2]
 	// ---
 
+	// Word TX streaming
+	spi_stream_wb spi_stream_I (
+		.s_addr   (wb_addr[4:0]),
+		.s_rdata  (wb_rdata[2]),
+		.s_wdata  (wb_wdata),
+		.s_we     (wb_we),
+		.s_cyc    (wb_cyc[2]),
+		.s_ack    (wb_ack[2]),
+		.m_addr   (spi_addr),
+		.m_rdata  (spi_rdata),
+		.m_wdata  (spi_wdata),
+		.m_we     (spi_we),
+		.m_cyc    (spi_cyc),
+		.m_ack    (spi_ack),
+		.clk      (clk_24m),
+		.rst      (rst)
+	);
+
+	// Core
 	ice40_spi_wb #(
 		.N_CS(1),
 		.WITH_IOB(1),
@@ -316,12 +383,12 @@ module top (
 		.pad_miso (spi_miso),
 		.pad_clk  (spi_clk),
 		.pad_csn  (spi_cs_n),
-		.wb_addr  (wb_addr[3:0]),
-		.wb_rdata (wb_rdata[2]),
-		.wb_wdata (wb_wdata),
-		.wb_we    (wb_we),
-		.wb_cyc   (wb_cyc[2]),
-		.wb_ack   (wb_ack[2]),
+		.wb_addr  (spi_addr),
+		.wb_rdata (spi_rdata),
+		.wb_wdata (spi_wdata),
+		.wb_we    (spi_we),
+		.wb_cyc   (spi_cyc),
+		.wb_ack   (spi_ack),
 		.clk      (clk_24m),
 		.rst      (rst)
 	);
@@ -430,6 +497,33 @@ module top (
 	);
 
 
+	// SPI trace [6]
+	// ---------
+
+`ifdef SPI_TRACE
+	spi_trace #(
+		.AW(10)
+	) spi_trace_I (
+		.wb_addr   (wb_addr[10:0]),
+		.wb_rdata  (wb_rdata[6]),
+		.wb_wdata  (wb_wdata),
+		.wb_we     (wb_we),
+		.wb_cyc    (wb_cyc[6]),
+		.wb_ack    (wb_ack[6]),
+		.spi_addr  (spi_addr),
+		.spi_wdata (spi_wdata),
+		.spi_we    (spi_we),
+		.spi_cyc   (spi_cyc),
+		.spi_ack   (spi_ack),
+		.clk       (clk_24m),
+		.rst       (rst)
+	);
+`else
+	assign wb_ack[6] = wb_cyc[6];
+	assign wb_rdata[6] = 32'h00000000;	// Not present
+`endif
+
+
 	// Special Features
 	// ----------------
 
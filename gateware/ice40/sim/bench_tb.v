@@ -0,0 +1,190 @@
+/*
+ * bench_tb.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Boot performance benchmark
+ *
+ * Runs the full SoC, boot ROM and DFU firmware (loaded in the flash model
+ * through +firmware=) until the firmware init is complete and reports
+ * the boot trace milestones along with the boot ROM flash copy rate.
+ *
+ * Results are printed as "BENCH <name> <value> <lower|higher>" lines,
+ * the last field telling which direction is an improvement. They're
+ * collected and checked against the stored baseline by utils/bench.py.
+ *
+ * There is no USB host model, so the USB pull-up being enabled is the
+ * last point that can be measured on the way to enumeration.
+ *
+ * With ENABLE_UART, the console output is passed through line by line
+ * and the run continues until the first command prompt, so firmware side
+ * benchmarks (MEMOPS_BENCH=1) are collected too.
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+`timescale 1 ns / 1 ps
+`include "boards.vh"
+
+module bench_tb;
+
+	// Signals
+	// -------
+
+	reg clk_48m = 1'b0;
+	reg clk_24m = 1'b0;
+	reg rst = 1'b1;
+
+	wire spi_mosi;
+	wire spi_miso;
+	wire spi_clk;
+	wire spi_cs_n;
+
+	wire usb_dp;
+	wire usb_dn;
+	wire usb_pu;
+
+	wire uart_tx;
+	reg [8*160-1:0] uart_line = 0;
+	reg uart_prompt = 1'b0;
+
+	integer cyc = 0;
+	integer spi_bits = 0;
+	integer t_pu = 0;
+
+
+	// Setup
+	// -----
+
+	initial begin
+		# 500000000;
+		$display("BENCH timeout: firmware init not done");
+		$finish;
+	end
+
+	always #10.417 clk_48m <= !clk_48m;
+
+	always @(posedge clk_48m)
+		clk_24m <= !clk_24m;
+
+	initial begin
+		# 1000;
+		@(posedge clk_24m) rst <= 1'b0;
+	end
+
+	// Timestamps in 24 MHz cycles since reset release, same as the
+	// boot trace counter
+	always @(posedge clk_24m)
+		if (!rst)
+			cyc <= cyc + 1;
+
+
+	// DUT
+	// ---
+
+	top dut_I (
+`ifdef ENABLE_UART
+		.uart_rx  (1'b1),
+		.uart_tx  (uart_tx),
+`endif
+`ifndef USE_HF_OSC
+		.clk_in   (1'b0),
+`endif
+		.btn      (1'b1),
+		.usb_dp   (usb_dp),
+		.usb_dn   (usb_dn),
+		.usb_pu   (usb_pu),
+		.spi_mosi (spi_mosi),
+		.spi_miso (spi_miso),
+		.spi_clk  (spi_clk),
+		.spi_cs_n (spi_cs_n)
+	);
+
+	// No PLL model, feed the clocks / reset directly
+	initial begin
+		force dut_I.clk_48m = clk_48m;
+		force dut_I.clk_24m = clk_24m;
+		force dut_I.rst = rst;
+	end
+
+
+	// Support
+	// -------
+
+	pullup(usb_dp);
+	pullup(usb_dn);
+	pullup(uart_tx);
+
+	// Commands not supported by the model read as 0xff
+	pullup(spi_miso);
+
+	spiflash flash_I (
+		.csb (spi_cs_n),
+		.clk (spi_clk),
+		.io0 (spi_mosi),
+		.io1 (spi_miso),
+		.io2 (),
+		.io3 ()
+	);
+
+
+	// Measurements
+	// ------------
+
+	// Bits read from flash by the boot ROM
+	always @(posedge spi_clk)
+		if (!spi_cs_n && !dut_I.trace_I.ms[1][31])
+			spi_bits <= spi_bits + 1;
+
+	always @(posedge usb_pu)
+		if (!t_pu)
+			t_pu = cyc;
+
+	initial begin
+		wait (dut_I.trace_I.ms[5][31]);
+		$display("BENCH boot.rom_done_us %0d lower",    dut_I.trace_I.ms[1][30:0] / 24);
+		$display("BENCH boot.main_us %0d lower",        dut_I.trace_I.ms[2][30:0] / 24);
+		$display("BENCH boot.usb_connect_us %0d lower", dut_I.trace_I.ms[3][30:0] / 24);
+		$display("BENCH boot.init_done_us %0d lower",   dut_I.trace_I.ms[5][30:0] / 24);
+		$display("BENCH boot.usb_pullup_us %0d lower", t_pu / 24);
+		$display("BENCH boot.rom_flash_read_kibps %0d higher",
+			$rtoi((spi_bits / 8.0) * 24.0e6 / 1024.0 / dut_I.trace_I.ms[1][30:0]));
+`ifdef ENABLE_UART
+		wait (uart_prompt);
+`endif
+		$finish;
+	end
+
+
+	// Console
+	// -------
+
+	// 1 Mbaud, one line at a time so it doesn't mix with the results
+
+	always @(negedge uart_tx)
+	begin : uart_rx
+		reg [7:0] b;
+		integer i;
+
+		# 500;
+		if (!uart_tx) begin
+			for (i=0; i<8; i=i+1) begin
+				# 1000;
+				b[i] = uart_tx;
+			end
+
+			if (b == 8'h0a) begin
+				$display("%0s", uart_line);
+				uart_line = 0;
+			end else begin
+				uart_line = { uart_line[8*159-1:0], b };
+				uart_prompt = uart_prompt | (b == ">");
+			end
+
+			# 1000;
+		end
+	end
+
+endmodule // bench_tb
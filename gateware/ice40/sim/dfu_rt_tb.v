@@ -0,0 +1,108 @@
+/*
+ * dfu_rt_tb.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module dfu_rt_tb;
+
+	// Signals
+	// -------
+
+	reg clk = 1'b0;
+	reg rst = 1'b1;
+
+	reg   [3:0] bus_addr  = 4'h0;
+	reg  [31:0] bus_wdata = 32'h00000000;
+	wire [31:0] bus_rdata;
+	reg         bus_we    = 1'b0;
+	reg         bus_cyc   = 1'b0;
+
+	integer errors = 0;
+
+
+	// Setup recording
+	// ---------------
+
+	initial begin
+		$dumpfile("dfu_rt_tb.vcd");
+		$dumpvars(0,dfu_rt_tb);
+		# 2000000 $finish;
+	end
+
+	always #10 clk <= !clk;
+
+	initial begin
+		#200 rst = 0;
+	end
+
+
+	// DUT
+	// ---
+
+	dfu_rt #(
+		.TIMER_WIDTH(12),
+		.BTN_MODE(3)
+	) dut_I (
+		.bus_addr  (bus_addr),
+		.bus_wdata (bus_wdata),
+		.bus_rdata (bus_rdata),
+		.bus_we    (bus_we),
+		.bus_cyc   (bus_cyc),
+		.btn_pad   (1'b1),
+		.btn_tick  (1'b0),
+		.btn_val   (),
+		.rst_req   (),
+		.clk       (clk),
+		.rst       (rst)
+	);
+
+
+	// Stimulus
+	// --------
+
+	task bus_write;
+		input [3:0] addr;
+		input [31:0] data;
+		begin
+			@(posedge clk);
+			bus_addr  <= addr;
+			bus_wdata <= data;
+			bus_we    <= 1'b1;
+			bus_cyc   <= 1'b1;
+			@(posedge clk);
+			bus_we    <= 1'b0;
+			bus_cyc   <= 1'b0;
+		end
+	endtask
+
+	initial
+	begin : test
+		#1000;
+
+		// Nothing happens on its own
+		if (dut_I.helper_I.wb_now) begin
+			$display("DFU RT: spurious boot");
+			errors = errors + 1;
+		end
+
+		// Detach : warmboot to image 1
+		bus_write(4'h0, 32'h00000005);
+
+		repeat (4) @(posedge clk);
+
+		if (!dut_I.helper_I.wb_now || (dut_I.helper_I.wb_sel != 2'b01)) begin
+			$display("DFU RT: no boot to image 1 (now %b, sel %b)", dut_I.helper_I.wb_now, dut_I.helper_I.wb_sel);
+			errors = errors + 1;
+		end
+
+		$display("DFU RT test: %0s", errors ? "FAIL" : "PASS");
+		$finish;
+	end
+
+endmodule // dfu_rt_tb
@@ -0,0 +1,191 @@
+/*
+ * sb_spi.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Minimal behavioral model of the iCE40 UltraPlus SB_SPI hard IP
+ *
+ * The yosys simulation library only has a black box for it, which means
+ * nothing using the SPI (and so the boot ROM) can run in simulation.
+ *
+ * Only what the boot ROM and the firmware use is modeled : master mode,
+ * CPOL=0 / CPHA=0, MSB first, manual chip select through CSR and the
+ * TRDY / RRDY status flags. SCK runs at SBCLKI / (BR + 1) (BR >= 1) and
+ * the TLEAD / TTRAIL / TIDLE delays are not modeled, so timings are only
+ * meant to be compared between runs of this same model.
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module SB_SPI (
+	input  wire SBCLKI,
+	input  wire SBRWI,
+	input  wire SBSTBI,
+	input  wire SBADRI7, SBADRI6, SBADRI5, SBADRI4,
+	input  wire SBADRI3, SBADRI2, SBADRI1, SBADRI0,
+	input  wire SBDATI7, SBDATI6, SBDATI5, SBDATI4,
+	input  wire SBDATI3, SBDATI2, SBDATI1, SBDATI0,
+	output wire SBDATO7, SBDATO6, SBDATO5, SBDATO4,
+	output wire SBDATO3, SBDATO2, SBDATO1, SBDATO0,
+	output reg  SBACKO,
+	output wire SPIIRQ,
+	output wire SPIWKUP,
+	input  wire MI,
+	output wire SO,
+	output wire SOE,
+	input  wire SI,
+	output wire MO,
+	output wire MOE,
+	input  wire SCKI,
+	output wire SCKO,
+	output wire SCKOE,
+	input  wire SCSNI,
+	output wire MCSNO3, MCSNO2, MCSNO1, MCSNO0,
+	output wire MCSNOE3, MCSNOE2, MCSNOE1, MCSNOE0
+);
+
+	parameter BUS_ADDR74 = "0b0000";
+
+	localparam [3:0] UNIT =
+		(BUS_ADDR74 == "0b0000") ? 4'b0000 :
+		(BUS_ADDR74 == "0b0010") ? 4'b0010 :
+		4'b1111;
+
+
+	// Signals
+	// -------
+
+	// Bus
+	wire [7:0] addr;
+	wire [7:0] wdata;
+	reg  [7:0] rdata;
+	wire       sel;
+
+	// Registers
+	reg  [7:0] cr1;
+	reg  [7:0] cr2;
+	reg  [7:0] br;
+	reg  [7:0] csr;
+	reg  [7:0] txdr;
+	reg  [7:0] rxdr;
+	reg        trdy;
+	reg        rrdy;
+
+	// Shifter
+	reg        active;
+	reg  [7:0] div;
+	reg  [2:0] bcnt;
+	reg  [7:0] sh_out;
+	reg  [7:0] sh_in;
+	reg        sck;
+
+
+	// Bus interface
+	// -------------
+
+	assign addr  = { SBADRI7, SBADRI6, SBADRI5, SBADRI4, SBADRI3, SBADRI2, SBADRI1, SBADRI0 };
+	assign wdata = { SBDATI7, SBDATI6, SBDATI5, SBDATI4, SBDATI3, SBDATI2, SBDATI1, SBDATI0 };
+	assign { SBDATO7, SBDATO6, SBDATO5, SBDATO4, SBDATO3, SBDATO2, SBDATO1, SBDATO0 } = rdata;
+
+	assign sel = SBSTBI & (addr[7:4] == UNIT);
+
+	initial begin
+		SBACKO = 1'b0;
+		rdata  = 8'h00;
+		cr1    = 8'h00;
+		cr2    = 8'h00;
+		br     = 8'h00;
+		csr    = 8'hff;
+		txdr   = 8'h00;
+		rxdr   = 8'h00;
+		trdy   = 1'b1;
+		rrdy   = 1'b0;
+		active = 1'b0;
+		div    = 8'h00;
+		bcnt   = 3'd0;
+		sh_out = 8'h00;
+		sh_in  = 8'h00;
+		sck    = 1'b0;
+	end
+
+	always @(posedge SBCLKI)
+	begin
+		SBACKO <= sel & ~SBACKO;
+		rdata  <= 8'h00;
+
+		if (sel & ~SBACKO) begin
+			if (SBRWI) begin
+				case (addr[3:0])
+					4'h9: cr1  <= wdata;
+					4'ha: cr2  <= wdata;
+					4'hb: br   <= wdata;
+					4'hd: begin txdr <= wdata; trdy <= 1'b0; end
+					4'hf: csr  <= wdata;
+				endcase
+			end else begin
+				case (addr[3:0])
+					4'h9: rdata <= cr1;
+					4'ha: rdata <= cr2;
+					4'hb: rdata <= br;
+					4'hc: rdata <= { active, active, 1'b0, trdy, rrdy, 3'b000 };
+					4'he: begin rdata <= rxdr; rrdy <= 1'b0; end
+					4'hf: rdata <= csr;
+				endcase
+			end
+		end
+
+		// Shifter (mode 0, one SCK period is BR+1 clocks)
+		if (~active) begin
+			if (~trdy & cr1[7]) begin
+				active <= 1'b1;
+				sh_out <= txdr;
+				trdy   <= 1'b1;
+				div    <= 8'h00;
+				bcnt   <= 3'd0;
+				sck    <= 1'b0;
+			end
+		end else begin
+			div <= (div == br) ? 8'h00 : (div + 1);
+
+			if (div == (br >> 1)) begin
+				// Rising edge : sample
+				sck   <= 1'b1;
+				sh_in <= { sh_in[6:0], MI };
+			end
+
+			if (div == br) begin
+				// Falling edge : shift
+				sck    <= 1'b0;
+				sh_out <= { sh_out[6:0], 1'b0 };
+				bcnt   <= bcnt + 1;
+
+				if (bcnt == 3'd7) begin
+					active <= 1'b0;
+					rxdr   <= sh_in;
+					rrdy   <= 1'b1;
+				end
+			end
+		end
+	end
+
+
+	// SPI signals
+	// -----------
+
+	assign MO    = sh_out[7];
+	assign MOE   = cr1[7] & cr2[7];
+	assign SCKO  = sck;
+	assign SCKOE = cr1[7] & cr2[7];
+
+	assign { MCSNO3, MCSNO2, MCSNO1, MCSNO0 } = csr[3:0];
+	assign { MCSNOE3, MCSNOE2, MCSNOE1, MCSNOE0 } = {4{cr1[7] & cr2[7]}};
+
+	assign SO      = 1'b0;
+	assign SOE     = 1'b0;
+	assign SPIIRQ  = 1'b0;
+	assign SPIWKUP = 1'b0;
+
+endmodule // SB_SPI
@@ -0,0 +1,298 @@
+/*
+ * spi_stream_wb_tb.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module spi_stream_wb_tb;
+
+	// Signals
+	// -------
+
+	reg clk = 1'b0;
+	reg rst = 1'b1;
+
+	integer cyc = 0;
+
+	reg   [4:0] s_addr  = 5'h00;
+	wire [31:0] s_rdata;
+	reg  [31:0] s_wdata = 32'h00000000;
+	reg         s_we    = 1'b0;
+	reg         s_cyc   = 1'b0;
+	wire        s_ack;
+
+	wire  [3:0] m_addr;
+	reg  [31:0] m_rdata = 32'h00000000;
+	wire [31:0] m_wdata;
+	wire        m_we;
+	wire        m_cyc;
+	reg         m_ack   = 1'b0;
+
+	reg  [31:0] rd;
+
+	integer errors = 0;
+	integer n;
+
+
+	// Setup recording
+	// ---------------
+
+	initial begin
+		$dumpfile("spi_stream_wb_tb.vcd");
+		$dumpvars(0,spi_stream_wb_tb);
+		# 2000000 $finish;
+	end
+
+	always #10 clk <= !clk;
+
+	always @(posedge clk)
+		cyc <= cyc + 1;
+
+	initial begin
+		#200 rst = 0;
+	end
+
+
+	// DUT
+	// ---
+
+	spi_stream_wb dut_I (
+		.s_addr  (s_addr),
+		.s_rdata (s_rdata),
+		.s_wdata (s_wdata),
+		.s_we    (s_we),
+		.s_cyc   (s_cyc),
+		.s_ack   (s_ack),
+		.m_addr  (m_addr),
+		.m_rdata (m_rdata),
+		.m_wdata (m_wdata),
+		.m_we    (m_we),
+		.m_cyc   (m_cyc),
+		.m_ack   (m_ack),
+		.clk     (clk),
+		.rst     (rst)
+	);
+
+
+	// SPI core model
+	// --------------
+
+	// SB_SPI registers as seen through the ice40_spi_wb wrapper (SR, TXDR,
+	// RXDR, CSR), one byte every BYTE_CYC cycles, and a flash behind it
+	// answering 05h with its status register (busy until `busy_until`).
+	// Other commands are logged.
+
+	localparam integer BYTE_CYC = 16;
+
+	reg   [3:0] csr  = 4'hf;
+	reg   [7:0] txdr = 8'h00;
+	reg   [7:0] rxdr = 8'h00;
+	reg         trdy = 1'b1;
+	reg         rrdy = 1'b0;
+	integer     xfer = 0;
+
+	integer     busy_until = 0;
+	reg   [7:0] f_cmd = 8'h00;
+	integer     f_idx = 0;
+	integer     f_len = 0;
+	reg   [7:0] f_log[0:15];
+	integer     f_log_n = 0;
+	integer     n_poll = 0;
+
+	wire  [7:0] f_sr1 = (cyc < busy_until) ? 8'h03 : 8'h00;
+
+	always @(posedge clk)
+	begin
+		m_ack   <= m_cyc & ~m_ack;
+		m_rdata <= 32'h00000000;
+
+		// Bus
+		if (m_cyc & ~m_ack) begin
+			if (m_we) begin
+				case (m_addr)
+					4'hd: begin
+						txdr <= m_wdata[7:0];
+						trdy <= 1'b0;
+						xfer <= BYTE_CYC;
+					end
+
+					4'hf: begin
+						if (xfer != 0) begin
+							$display("[!] CS change in the middle of a byte");
+							errors = errors + 1;
+						end
+
+						if (csr[0] & ~m_wdata[0])
+							f_idx <= 0;
+
+						if (~csr[0] & m_wdata[0]) begin
+							f_len <= f_idx;
+							if (f_cmd == 8'h05) begin
+								n_poll <= n_poll + 1;
+								if (f_idx != 2) begin
+									$display("[!] Status read of %0d bytes", f_idx);
+									errors = errors + 1;
+								end
+							end
+						end
+
+						csr <= m_wdata[3:0];
+					end
+				endcase
+			end else begin
+				case (m_addr)
+					4'hc: m_rdata <= { 27'h0000000, trdy, rrdy, 3'b000 };
+					4'he: begin m_rdata <= { 24'h000000, rxdr }; rrdy <= 1'b0; end
+					4'hf: m_rdata <= { 28'h0000000, csr };
+				endcase
+			end
+		end
+
+		// Byte transfer
+		if (xfer != 0) begin
+			xfer <= xfer - 1;
+
+			if (xfer == 1) begin
+				trdy <= 1'b1;
+				rrdy <= 1'b1;
+				rxdr <= ((f_idx != 0) && (f_cmd == 8'h05)) ? f_sr1 : 8'hff;
+
+				if (~csr[0]) begin
+					if (f_idx == 0)
+						f_cmd <= txdr;
+
+					if ((((f_idx == 0) ? txdr : f_cmd) != 8'h05) && (f_log_n < 16)) begin
+						f_log[f_log_n] <= txdr;
+						f_log_n <= f_log_n + 1;
+					end
+
+					f_idx <= f_idx + 1;
+				end
+			end
+		end
+	end
+
+
+	// Stimulus
+	// --------
+
+	task bus_write;
+		input  [4:0] addr;
+		input [31:0] data;
+		begin
+			@(posedge clk);
+			s_addr  <= addr;
+			s_wdata <= data;
+			s_we    <= 1'b1;
+			s_cyc   <= 1'b1;
+			@(posedge clk);
+			while (!s_ack)
+				@(posedge clk);
+			s_we    <= 1'b0;
+			s_cyc   <= 1'b0;
+		end
+	endtask
+
+	task bus_read;
+		input   [4:0] addr;
+		output [31:0] data;
+		begin
+			@(posedge clk);
+			s_addr  <= addr;
+			s_cyc   <= 1'b1;
+			@(posedge clk);
+			while (!s_ack)
+				@(posedge clk);
+			data = s_rdata;
+			s_cyc   <= 1'b0;
+		end
+	endtask
+
+	initial
+	begin : test
+		#1000;
+
+		// Word push : sent LSB first, CS release waits for the last byte
+		bus_write(5'h0f, 32'h0000000e);
+		bus_write(5'h10, 32'h0403029f);
+		bus_write(5'h0f, 32'h0000000f);
+
+		if ((f_len != 4) || (f_log_n != 4) ||
+		    (f_log[0] != 8'h9f) || (f_log[1] != 8'h02) || (f_log[2] != 8'h03) || (f_log[3] != 8'h04)) begin
+			$display("SPI stream: bad word push (%0d bytes in CS, %02x %02x %02x %02x)",
+				f_len, f_log[0], f_log[1], f_log[2], f_log[3]);
+			errors = errors + 1;
+		end
+
+		bus_read(5'h10, rd);
+		if (rd != 0) begin
+			$display("SPI stream: push not done (%08x)", rd);
+			errors = errors + 1;
+		end
+
+		// Busy poll until the flash is idle, status reads don't stop it
+		busy_until = cyc + 3000;
+		bus_write(5'h11, 32'h80000000 | 100);
+
+		rd = 32'h80000000;
+		while (rd[31])
+			bus_read(5'h11, rd);
+
+		if (!rd[8] || rd[0] || (n_poll < 2) || (cyc < busy_until) || (csr != 4'hf)) begin
+			$display("SPI stream: bad poll result %08x after %0d polls", rd, n_poll);
+			errors = errors + 1;
+		end
+
+		// Any other access clears 'Done'
+		bus_read(5'h0f, rd);
+		bus_read(5'h11, rd);
+		if (rd[8]) begin
+			$display("SPI stream: 'Done' not cleared (%08x)", rd);
+			errors = errors + 1;
+		end
+
+		// CPU access during a poll : waits for the status read in progress,
+		// then goes through and the poller is stopped
+		busy_until = cyc + 1000000;
+		bus_write(5'h11, 32'h80000000 | 200);
+		repeat (500) @(posedge clk);
+
+		bus_read(5'h0f, rd);
+		if (rd[3:0] != 4'hf) begin
+			$display("SPI stream: CPU access in the middle of a status read (CSR %08x)", rd);
+			errors = errors + 1;
+		end
+
+		bus_read(5'h11, rd);
+		if (rd[31] || rd[8] || !rd[0]) begin
+			$display("SPI stream: poller not stopped (%08x)", rd);
+			errors = errors + 1;
+		end
+
+		n = n_poll;
+		repeat (2000) @(posedge clk);
+		if (n_poll != n) begin
+			$display("SPI stream: %0d status reads after stop", n_poll - n);
+			errors = errors + 1;
+		end
+
+		// And the SPI is usable right away
+		bus_write(5'h0f, 32'h0000000e);
+		bus_write(5'h10, 32'h00000006);
+		bus_write(5'h0f, 32'h0000000f);
+
+		if ((f_len != 4) || (f_log_n != 8) || (f_log[4] != 8'h06)) begin
+			$display("SPI stream: bad push after poll (%0d bytes, %02x)", f_len, f_log[4]);
+			errors = errors + 1;
+		end
+
+		$display("SPI stream test: %0s", errors ? "FAIL" : "PASS");
+		$finish;
+	end
+
+endmodule // spi_stream_wb_tb
@@ -0,0 +1,225 @@
+/*
+ * spi_trace_tb.v
+ *
+ * vim: ts=4 sw=4
+ *
+ * Copyright (C) 2026  agent <agent@local>
+ * SPDX-License-Identifier: CERN-OHL-P-2.0
+ */
+
+`default_nettype none
+
+module spi_trace_tb;
+
+	localparam integer AW = 10;
+
+	// Signals
+	// -------
+
+	reg clk = 1'b0;
+	reg rst = 1'b1;
+
+	reg  [AW:0] wb_addr  = 0;
+	wire [31:0] wb_rdata;
+	reg  [31:0] wb_wdata = 32'h00000000;
+	reg         wb_we    = 1'b0;
+	reg         wb_cyc   = 1'b0;
+	wire        wb_ack;
+
+	reg   [3:0] spi_addr  = 4'h0;
+	reg  [31:0] spi_wdata = 32'h00000000;
+	reg         spi_we    = 1'b0;
+	reg         spi_cyc   = 1'b0;
+
+	reg  [31:0] rd;
+	reg  [31:0] ent[0:3];
+
+	integer errors = 0;
+	integer i;
+
+
+	// Setup recording
+	// ---------------
+
+	initial begin
+		$dumpfile("spi_trace_tb.vcd");
+		$dumpvars(0,spi_trace_tb);
+		# 2000000 $finish;
+	end
+
+	always #10 clk <= !clk;
+
+	initial begin
+		#200 rst = 0;
+	end
+
+
+	// DUT
+	// ---
+
+	spi_trace #(
+		.AW(AW)
+	) dut_I (
+		.wb_addr   (wb_addr),
+		.wb_rdata  (wb_rdata),
+		.wb_wdata  (wb_wdata),
+		.wb_we     (wb_we),
+		.wb_cyc    (wb_cyc),
+		.wb_ack    (wb_ack),
+		.spi_addr  (spi_addr),
+		.spi_wdata (spi_wdata),
+		.spi_we    (spi_we),
+		.spi_cyc   (spi_cyc),
+		.spi_ack   (spi_cyc),
+		.clk       (clk),
+		.rst       (rst)
+	);
+
+
+	// Stimulus
+	// --------
+
+	task bus_write;
+		input [AW:0] addr;
+		input [31:0] data;
+		begin
+			@(posedge clk);
+			wb_addr  <= addr;
+			wb_wdata <= data;
+			wb_we    <= 1'b1;
+			wb_cyc   <= 1'b1;
+			@(posedge clk);
+			while (!wb_ack)
+				@(posedge clk);
+			wb_we    <= 1'b0;
+			wb_cyc   <= 1'b0;
+		end
+	endtask
+
+	task bus_read;
+		input  [AW:0] addr;
+		output [31:0] data;
+		begin
+			@(posedge clk);
+			wb_addr  <= addr;
+			wb_cyc   <= 1'b1;
+			@(posedge clk);
+			while (!wb_ack)
+				@(posedge clk);
+			data = wb_rdata;
+			wb_cyc   <= 1'b0;
+		end
+	endtask
+
+	// One acked access on the snooped SPI bus
+	task spi_access;
+		input  [3:0] addr;
+		input        we;
+		input [31:0] data;
+		begin
+			@(posedge clk);
+			spi_addr  <= addr;
+			spi_wdata <= data;
+			spi_we    <= we;
+			spi_cyc   <= 1'b1;
+			@(posedge clk);
+			spi_cyc   <= 1'b0;
+			spi_we    <= 1'b0;
+		end
+	endtask
+
+	task spi_byte;
+		input [7:0] data;
+		input integer len;
+		begin
+			spi_access(4'hd, 1'b1, { 24'h000000, data });
+			repeat (len - 2) @(posedge clk);
+			spi_access(4'he, 1'b0, 32'h00000000);
+		end
+	endtask
+
+	initial
+	begin : test
+		#1000;
+
+		// Present, AW
+		bus_read(0, rd);
+		if (!rd[31] || (rd[23:16] != AW) || rd[1]) begin
+			$display("SPI trace: bad CSR %08x", rd);
+			errors = errors + 1;
+		end
+
+		// Not capturing yet
+		spi_access(4'hf, 1'b1, 32'h0000000e);
+
+		// Clear + enable, one-shot
+		bus_write(0, 32'h00000007);
+
+		// JEDEC ID : CS, opcode, 3 bytes, CS
+		repeat (20) @(posedge clk);
+		spi_access(4'hf, 1'b1, 32'h0000000e);
+		repeat (5) @(posedge clk);
+		spi_byte(8'h9f, 16);
+		spi_byte(8'h00, 16);
+		spi_byte(8'h00, 16);
+		repeat (3) @(posedge clk);
+		spi_byte(8'h00, 16);
+		spi_access(4'hf, 1'b1, 32'h0000000f);
+
+		bus_read(1, rd);
+		if (rd != 6) begin
+			$display("SPI trace: %0d entries, expected 6", rd);
+			errors = errors + 1;
+		end
+
+		for (i=0; i<4; i=i+1)
+			bus_read((1 << AW) + i, ent[i]);
+
+		if ((ent[0][31:24] != 8'h0e) || (ent[0][23:0] < 20) || (ent[0][23:0] > 30)) begin
+			$display("SPI trace: bad CS entry %08x", ent[0]);
+			errors = errors + 1;
+		end
+
+		if (!ent[1][31] || (ent[1][30:23] != 8'h9f) || (ent[1][22:11] < 5) || (ent[1][22:11] > 8) || (ent[1][10:0] != 16)) begin
+			$display("SPI trace: bad opcode entry %08x", ent[1]);
+			errors = errors + 1;
+		end
+
+		if (!ent[3][31] || (ent[3][22:11] != ent[2][22:11] + 3) || (ent[3][10:0] != 16)) begin
+			$display("SPI trace: bad byte entries %08x %08x", ent[2], ent[3]);
+			errors = errors + 1;
+		end
+
+		// Fill it, one-shot stops when full
+		for (i=0; i<(1 << AW); i=i+1)
+			spi_access(4'hf, 1'b1, 32'h00000005);
+
+		bus_read(0, rd);
+		if (!rd[30] || !rd[1]) begin
+			$display("SPI trace: not full (CSR %08x)", rd);
+			errors = errors + 1;
+		end
+
+		bus_read(1, rd);
+		if (rd != 0) begin
+			$display("SPI trace: wrote past the end (%0d)", rd);
+			errors = errors + 1;
+		end
+
+		bus_read((1 << AW), rd);
+		if (rd != ent[0]) begin
+			$display("SPI trace: first entry overwritten (%08x)", rd);
+			errors = errors + 1;
+		end
+
+		bus_read((2 << AW) - 1, rd);
+		if (rd[31:24] != 8'h05) begin
+			$display("SPI trace: bad last entry %08x", rd);
+			errors = errors + 1;
+		end
+
+		$display("SPI trace test: %0s", errors ? "FAIL" : "PASS");
+		$finish;
+	end
+
+endmodule // spi_trace_tb
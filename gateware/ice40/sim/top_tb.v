@@ -3,29 +3,61 @@
  *
  * vim: ts=4 sw=4
  *
+ * Full SoC with the DFU firmware (loaded in the flash model through
+ * +firmware=, built with ENABLE_UART=1) exercising the UART flashing
+ * protocol : INFO, then READ of the start of the firmware image that's
+ * checked against the flash model content.
+ *
  * Copyright (C) 2019-2020  Sylvain Munaut <tnt@246tNt.com>
  * SPDX-License-Identifier: CERN-OHL-P-2.0
  */
 
 `default_nettype none
+`timescale 1 ns / 1 ps
+`include "boards.vh"
 
 module top_tb;
 
+	// Params
+	// ------
+
+	localparam integer UART_BIT = 1000;			// 1 Mbaud
+	localparam integer READ_ADDR = 32'h00060000;
+	localparam integer READ_LEN  = 16;
+
+
 	// Signals
 	// -------
 
+	reg clk_48m = 1'b0;
+	reg clk_24m = 1'b0;
+	reg rst = 1'b1;
+
 	wire spi_mosi;
 	wire spi_miso;
-	wire spi_flash_cs_n;
 	wire spi_clk;
+	wire spi_cs_n;
 
 	wire usb_dp;
 	wire usb_dn;
 	wire usb_pu;
 
-	wire uart_rx;
+	reg  uart_rx = 1'b1;
 	wire uart_tx;
 
+	// UART receive buffer
+	reg [7:0] rx_buf[0:4095];
+	integer   rx_wr = 0;
+	integer   rx_rd = 0;
+
+	// Last received frame
+	reg [7:0] f_type;
+	reg [7:0] f_seq;
+	reg [7:0] f_data[0:511];
+	integer   f_len;
+
+	integer errors = 0;
+
 
 	// Setup recording
 	// ---------------
@@ -33,7 +65,19 @@ module top_tb;
 	initial begin
 		$dumpfile("top_tb.vcd");
 		$dumpvars(0,top_tb);
-		# 2000000 $finish;
+		# 500000000;
+		$display("UART test: FAIL (timeout)");
+		$finish;
+	end
+
+	always #10.417 clk_48m <= !clk_48m;
+
+	always @(posedge clk_48m)
+		clk_24m <= !clk_24m;
+
+	initial begin
+		# 1000;
+		@(posedge clk_24m) rst <= 1'b0;
 	end
 
 
@@ -41,36 +85,211 @@ module top_tb;
 	// ---
 
 	top dut_I (
-		.spi_mosi(spi_mosi),
-		.spi_miso(spi_miso),
-		.spi_flash_cs_n(spi_flash_cs_n),
-		.spi_clk(spi_clk),
-		.usb_dp(usb_dp),
-		.usb_dn(usb_dn),
-		.usb_pu(usb_pu),
-		.uart_rx(uart_rx),
-		.uart_tx(uart_tx),
-		.rgb(),
-		.clk_in(1'b0)
+`ifdef ENABLE_UART
+		.uart_rx  (uart_rx),
+		.uart_tx  (uart_tx),
+`endif
+`ifndef USE_HF_OSC
+		.clk_in   (1'b0),
+`endif
+		.btn      (1'b1),
+		.usb_dp   (usb_dp),
+		.usb_dn   (usb_dn),
+		.usb_pu   (usb_pu),
+		.spi_mosi (spi_mosi),
+		.spi_miso (spi_miso),
+		.spi_clk  (spi_clk),
+		.spi_cs_n (spi_cs_n)
 	);
 
+	// No PLL model, feed the clocks / reset directly
+	initial begin
+		force dut_I.clk_48m = clk_48m;
+		force dut_I.clk_24m = clk_24m;
+		force dut_I.rst = rst;
+	end
+
 
 	// Support
 	// -------
 
 	pullup(usb_dp);
 	pullup(usb_dn);
-
 	pullup(uart_tx);
-	pullup(uart_rx);
+	pullup(spi_miso);
 
 	spiflash flash_I (
-		.csb(spi_flash_cs_n),
-		.clk(spi_clk),
-		.io0(spi_mosi),
-		.io1(spi_miso),
-		.io2(),
-		.io3()
+		.csb (spi_cs_n),
+		.clk (spi_clk),
+		.io0 (spi_mosi),
+		.io1 (spi_miso),
+		.io2 (),
+		.io3 ()
 	);
 
+
+	// UART
+	// ----
+
+	task uart_send;
+		input [7:0] b;
+		integer i;
+		begin
+			uart_rx = 1'b0;
+			# UART_BIT;
+			for (i=0; i<8; i=i+1) begin
+				uart_rx = b[i];
+				# UART_BIT;
+			end
+			uart_rx = 1'b1;
+			# UART_BIT;
+		end
+	endtask
+
+	always @(negedge uart_tx)
+	begin : rx
+		reg [7:0] b;
+		integer i;
+
+		# (UART_BIT / 2);
+		if (!uart_tx) begin
+			for (i=0; i<8; i=i+1) begin
+				# UART_BIT;
+				b[i] = uart_tx;
+			end
+			rx_buf[rx_wr[11:0]] = b;
+			rx_wr = rx_wr + 1;
+			# UART_BIT;
+		end
+	end
+
+	task uart_recv;
+		output [7:0] b;
+		begin
+			wait (rx_rd != rx_wr);
+			b = rx_buf[rx_rd[11:0]];
+			rx_rd = rx_rd + 1;
+		end
+	endtask
+
+
+	// Framing
+	// -------
+
+	function [31:0] crc32_byte;
+		input [31:0] crc;
+		input  [7:0] b;
+		integer i;
+		begin
+			crc = crc ^ b;
+			for (i=0; i<8; i=i+1)
+				crc = (crc >> 1) ^ (crc[0] ? 32'hedb88320 : 32'h00000000);
+			crc32_byte = crc;
+		end
+	endfunction
+
+	task frame_send;
+		input [7:0] typ;
+		input [7:0] seq;
+		input [8*8-1:0] payload;	// Up to 8 bytes, first byte in the MSBs
+		input integer len;
+		reg [31:0] crc;
+		reg  [7:0] b;
+		integer i;
+		begin
+			crc = 32'hffffffff;
+			uart_send(8'ha5);
+			uart_send(typ);             crc = crc32_byte(crc, typ);
+			uart_send(seq);             crc = crc32_byte(crc, seq);
+			uart_send(len[7:0]);        crc = crc32_byte(crc, len[7:0]);
+			uart_send(8'h00);           crc = crc32_byte(crc, 8'h00);
+			for (i=0; i<len; i=i+1) begin
+				b = payload >> (8 * (len - 1 - i));
+				uart_send(b);
+				crc = crc32_byte(crc, b);
+			end
+			crc = ~crc;
+			for (i=0; i<4; i=i+1)
+				uart_send(crc >> (8 * i));
+		end
+	endtask
+
+	task frame_recv;
+		reg [31:0] crc;
+		reg [31:0] crc_rx;
+		reg  [7:0] b;
+		integer i;
+		begin
+			// Skip console output
+			b = 0;
+			while (b != 8'ha5)
+				uart_recv(b);
+
+			crc = 32'hffffffff;
+			uart_recv(f_type);          crc = crc32_byte(crc, f_type);
+			uart_recv(f_seq);           crc = crc32_byte(crc, f_seq);
+			uart_recv(b);               crc = crc32_byte(crc, b); f_len = b;
+			uart_recv(b);               crc = crc32_byte(crc, b); f_len = f_len | (b << 8);
+			for (i=0; i<f_len; i=i+1) begin
+				uart_recv(f_data[i]);
+				crc = crc32_byte(crc, f_data[i]);
+			end
+			for (i=0; i<4; i=i+1) begin
+				uart_recv(b);
+				crc_rx[8*i+:8] = b;
+			end
+
+			if (~crc != crc_rx) begin
+				$display("UART: bad response CRC");
+				errors = errors + 1;
+			end
+		end
+	endtask
+
+
+	// Test
+	// ----
+
+	initial
+	begin : test
+		integer i;
+
+`ifndef ENABLE_UART
+		$display("UART test: needs ENABLE_UART=1");
+		$finish;
+`endif
+
+		// Wait for the firmware to be ready
+		wait (dut_I.trace_I.ms[5][31]);
+		# 100000;
+
+		// INFO
+		frame_send(8'h01, 8'h00, 64'h0, 0);
+		frame_recv;
+
+		if ((f_type != 8'h81) || (f_seq != 8'h00) || (f_len != 11) || (f_data[0] != 8'h00)) begin
+			$display("UART: bad INFO response (type %02x seq %02x len %0d status %02x)", f_type, f_seq, f_len, f_data[0]);
+			errors = errors + 1;
+		end else
+			$display("UART: protocol v%0d, window %0d", f_data[1], f_data[2]);
+
+		// READ
+		frame_send(8'h02, 8'h01, { READ_ADDR[7:0], READ_ADDR[15:8], READ_ADDR[23:16], READ_ADDR[31:24], READ_LEN[7:0], 8'h00 }, 6);
+		frame_recv;
+
+		if ((f_type != 8'h82) || (f_seq != 8'h01) || (f_len != (1 + READ_LEN)) || (f_data[0] != 8'h00)) begin
+			$display("UART: bad READ response (type %02x seq %02x len %0d status %02x)", f_type, f_seq, f_len, f_data[0]);
+			errors = errors + 1;
+		end else begin
+			for (i=0; i<READ_LEN; i=i+1)
+				if (f_data[1+i] !== flash_I.memory[READ_ADDR+i]) begin
+					$display("UART: READ data mismatch @%0d: %02x vs %02x", i, f_data[1+i], flash_I.memory[READ_ADDR+i]);
+					errors = errors + 1;
+				end
+		end
+
+		$display("UART test: %0s", errors ? "FAIL" : "PASS");
+		$finish;
+	end
+
 endmodule // top_tb
@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+#
+# A/B application slots management
+#
+# The multiboot layout reserves two application slots :
+#
+#   Slot A : bitstream @ 0x080000, firmware @ 0x0a0000
+#   Slot B : bitstream @ 0x0c0000, firmware @ 0x0e0000
+#
+# The stub and the DFU bootloader always warmboot image 2 ("App 1"). So
+# the active slot is simply the boot address stored for that image in the
+# multiboot header and switching slot only requires rewriting the header
+# sector. Going from B to A only clears bits and is programmed in place,
+# A to B needs that sector erased, see ABManager.activate().
+#
+# Note that the application itself must be built for the slot it's
+# written to (i.e. its boot ROM must load the firmware from the matching
+# firmware address).
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import signal
+import sys
+
+from no2bootloader import NO2Bootloader
+
+
+SLOTS = {
+	'A': (0x080000, 0x0a0000),
+	'B': (0x0c0000, 0x0e0000),
+}
+
+HDR_ENTRY_SIZE = 32
+HDR_ACTIVE_ENTRY = 3	# Power-on image, then warmboot images 0-3
+HDR_ADDR_OFS = 9		# Offset of the 24 bit boot address in an entry
+HDR_WRITE_RETRIES = 3
+
+ICE40_SYNC = b'\x7e\xaa\x99\x7e'
+
+
+def hdr_get_addr(hdr, entry):
+	o = entry * HDR_ENTRY_SIZE
+	if hdr[o:o+4] != ICE40_SYNC:
+		raise RuntimeError('Invalid multiboot header')
+	return int.from_bytes(hdr[o+HDR_ADDR_OFS:o+HDR_ADDR_OFS+3], 'big')
+
+
+def hdr_set_addr(hdr, entry, addr):
+	o = entry * HDR_ENTRY_SIZE + HDR_ADDR_OFS
+	hdr[o:o+3] = addr.to_bytes(3, 'big')
+
+
+class ABManager:
+
+	def __init__(self, bl):
+		self.bl = bl
+
+	def read(self, addr, l):
+		return b''.join([self.bl.flash_read(addr + o, min(256, l - o)) for o in range(0, l, 256)])
+
+	def active_slot(self):
+		addr = hdr_get_addr(self.read(0, 5 * HDR_ENTRY_SIZE), HDR_ACTIVE_ENTRY)
+		for k, (bs, fw) in SLOTS.items():
+			if bs == addr:
+				return k
+		raise RuntimeError(f'Active image @0x{addr:06x} is not an A/B slot')
+
+	def inactive_slot(self):
+		return 'B' if self.active_slot() == 'A' else 'A'
+
+	def slot_valid(self, slot):
+		return ICE40_SYNC in self.read(SLOTS[slot][0], 256)
+
+	def check_unlocked(self):
+		if self.bl.spi_exec(b'\x05', 1)[0] & 0x7c:
+			raise RuntimeError('Flash is write protected, enter the bootloader without flash lock to change the active slot')
+
+	def write_slot(self, slot, bs, fw, progress=None):
+		o_bs, o_fw = SLOTS[slot]
+
+		if slot == self.active_slot():
+			raise RuntimeError('Refusing to overwrite the active slot')
+
+		segments = [ (o_bs, bs) ] + ([ (o_fw, fw) ] if fw else [])
+		self.bl.flash_write_segments(segments, progress)
+
+		# Verify
+		for o, d in segments:
+			if self.read(o, len(d)) != d:
+				raise RuntimeError(f'Verification failed for slot {slot} @0x{o:06x}')
+
+	def activate(self, slot):
+		if not self.slot_valid(slot):
+			raise RuntimeError(f'Slot {slot} does not contain a valid bitstream')
+
+		self.check_unlocked()
+
+		# Patch a copy of the header sector
+		cur  = self.read(0, 4096)
+		sect = bytearray(cur)
+		hdr_set_addr(sect, HDR_ACTIVE_ENTRY, SLOTS[slot][0])
+
+		# Sanity check what's about to be written
+		for e in range(5):
+			hdr_get_addr(sect, e)
+
+		if sect == cur:
+			return
+
+		# If the new address only clears bits (e.g. going back to A), program
+		# it in place, there is no erase and so no window where the flash is
+		# not bootable
+		if all([(n & ~o) == 0 for n, o in zip(sect, cur)]):
+			p = (HDR_ACTIVE_ENTRY * HDR_ENTRY_SIZE) & ~255
+			self.bl.flash_program_page(p, bytes(sect[p:p+256]))
+
+		# Otherwise the sector has to be erased. Between that erase and the
+		# end of the programming, the flash can't cold boot at all (no
+		# multiboot header, so not even the stub @ 16k is loaded) : don't
+		# let a Ctrl-C interrupt it and retry from the copy held here if the
+		# read back doesn't match. Only the populated part (the five header
+		# entries) is programmed back
+		else:
+			l = len(sect.rstrip(b'\xff'))
+			sigint = signal.signal(signal.SIGINT, signal.SIG_IGN)
+			try:
+				for retry in range(HDR_WRITE_RETRIES):
+					self.bl.flash_write_segments([ (0, bytes(sect[0:l])) ])
+					if self.read(0, 4096) == sect:
+						break
+					print("Header sector read back mismatch, retrying", file=sys.stderr)
+				else:
+					raise RuntimeError('Header sector rewrite failed, the device will NOT boot until it is fixed. Do not power cycle it, retry the activation while the bootloader still runs')
+			finally:
+				signal.signal(signal.SIGINT, sigint)
+
+		if self.read(0, 4096) != sect or self.active_slot() != slot:
+			raise RuntimeError('Header verification failed')
+
+
+def main():
+	parser = argparse.ArgumentParser(description='A/B application slot update')
+	parser.add_argument('-S', '--serial', help='Serial number of the device to use')
+	sub = parser.add_subparsers(dest='cmd', required=True)
+	sub.add_parser('status', help='Show the active slot')
+	p = sub.add_parser('update', help='Write the inactive slot, verify it and activate it')
+	p.add_argument('bitstream')
+	p.add_argument('firmware', nargs='?')
+	p.add_argument('--no-activate', action='store_true', help='Only write and verify the inactive slot')
+	p = sub.add_parser('activate', help='Make the given slot active')
+	p.add_argument('slot', choices=sorted(SLOTS.keys()))
+	sub.add_parser('rollback', help='Switch back to the other slot')
+	args = parser.parse_args()
+
+	ab = ABManager(NO2Bootloader(serial=args.serial))
+
+	if args.cmd == 'status':
+		for k in sorted(SLOTS.keys()):
+			print(f"Slot {k}: {'valid' if ab.slot_valid(k) else 'empty'}{' (active)' if k == ab.active_slot() else ''}")
+
+	elif args.cmd == 'update':
+		slot = ab.inactive_slot()
+		bs = open(args.bitstream, 'rb').read()
+		fw = open(args.firmware, 'rb').read() if args.firmware else None
+		print(f"Writing slot {slot}", file=sys.stderr)
+		ab.write_slot(slot, bs, fw)
+		if not args.no_activate:
+			print(f"Activating slot {slot}", file=sys.stderr)
+			ab.activate(slot)
+
+	elif args.cmd == 'activate':
+		ab.activate(args.slot)
+
+	elif args.cmd == 'rollback':
+		ab.activate(ab.inactive_slot())
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
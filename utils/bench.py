@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Collect benchmark results and check them against a stored baseline
+#
+# Results are read as "BENCH <name> <value> <lower|higher>" lines (as
+# printed by the simulation benchmarks and `no2dfu.py --bench`), any
+# other line is passed through. The last field tells which direction
+# is an improvement.
+#
+# The baseline is a JSON file :
+#
+#   {
+#     "tolerance": 0.02,
+#     "metrics": {
+#       "<name>": { "value": <number or null>, "better": "lower|higher" },
+#       ...
+#     }
+#   }
+#
+# A `null` value means no reference was recorded yet. It fails the check
+# like a regression would, so a missing baseline can't go unnoticed, and so
+# do a missing baseline file and any baseline metric absent from the
+# results (benchmark not run, or cut short). Use --update to store the
+# current results as the new baseline.
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import json
+import sys
+
+
+def parse(fh, echo=None, prefix=''):
+	res = {}
+	for l in fh:
+		f = l.split()
+		if (len(f) == 4) and (f[0] == 'BENCH') and (f[3] in ('lower', 'higher')) and f[1].startswith(prefix):
+			res[f[1]] = { 'value': float(f[2]), 'better': f[3] }
+		elif echo:
+			echo.write(l)
+	return res
+
+
+def compare(base, res, tol):
+	"""Returns the list of (name, message, failed)"""
+	out = []
+
+	for k, b in sorted(base.items()):
+		if k not in res:
+			out.append( (k, 'missing from results', True) )
+			continue
+
+		v = res[k]['value']
+		if b['value'] is None:
+			out.append( (k, f'{v:g} (no baseline, use --update)', True) )
+			continue
+
+		ref = b['value']
+		if b['better'] == 'lower':
+			fail = v > ref * (1 + tol)
+		else:
+			fail = v < ref * (1 - tol)
+
+		delta = ((v - ref) / ref * 100) if ref else 0
+		out.append( (k, f'{v:g} vs {ref:g} ({delta:+.1f}%)', fail) )
+
+	for k in sorted(set(res) - set(base)):
+		out.append( (k, f"{res[k]['value']:g} (new)", False) )
+
+	return out
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Check benchmark results against a baseline')
+	parser.add_argument('-b', '--baseline', required=True, help='Baseline JSON file')
+	parser.add_argument('-o', '--output', help='Write the results to this JSON file')
+	parser.add_argument('-t', '--tolerance', type=float, help='Allowed relative regression (default: from baseline)')
+	parser.add_argument('-p', '--prefix', default='', help='Only consider the metrics starting with this')
+	parser.add_argument('--update', action='store_true', help='Store the results as the new baseline')
+	parser.add_argument('input', nargs='?', help='Benchmark output (default: stdin)')
+	args = parser.parse_args()
+
+	# Load
+	if args.input:
+		with open(args.input, 'r') as fh:
+			res = parse(fh, sys.stdout, args.prefix)
+	else:
+		res = parse(sys.stdin, sys.stdout, args.prefix)
+
+	if not res:
+		print('No benchmark results found', file=sys.stderr)
+		return 1
+
+	try:
+		with open(args.baseline, 'r') as fh:
+			base = json.load(fh)
+	except FileNotFoundError:
+		if not args.update:
+			print(f"Baseline {args.baseline} not found, use --update", file=sys.stderr)
+			return 1
+		base = { 'tolerance': 0.02, 'metrics': {} }
+
+	tol = args.tolerance if args.tolerance is not None else base.get('tolerance', 0.02)
+
+	# Save results
+	if args.output:
+		with open(args.output, 'w') as fh:
+			json.dump({ 'metrics': res }, fh, indent='\t', sort_keys=True)
+			fh.write('\n')
+
+	if args.update:
+		base['metrics'] = res
+		with open(args.baseline, 'w') as fh:
+			json.dump(base, fh, indent='\t', sort_keys=True)
+			fh.write('\n')
+		print(f"Baseline {args.baseline} updated", file=sys.stderr)
+		return 0
+
+	# Compare
+	fails = 0
+	for k, msg, fail in compare(base['metrics'], res, tol):
+		print(f"{'FAIL' if fail else 'ok  '} {k:32s} {msg}")
+		fails += fail
+
+	if fails:
+		print(f"{fails} failure(s), tolerance {tol * 100:.1f}%", file=sys.stderr)
+
+	return 1 if fails else 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+#
+# Show the boot milestones timestamps recorded by the DFU bootloader
+#
+# All times are relative to the gateware coming out of reset (i.e. PLL
+# lock). The configuration time of the FPGA itself and the PLL lock time
+# can't be measured from the inside and must be added from the datasheet
+# or measured externally.
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import sys
+
+from no2bootloader import NO2Bootloader
+
+
+CLK_FREQ = 24e6
+
+MILESTONES = [
+	'Reset release',
+	'Boot ROM done',
+	'main()',
+	'USB connect',
+	'First SETUP',
+	'Init done',
+]
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Show the bootloader boot milestones')
+	parser.add_argument('-S', '--serial', help='Serial number of the device to use')
+	args = parser.parse_args()
+
+	bl = NO2Bootloader(serial=args.serial)
+	ms, now = bl.get_boot_trace()
+
+	prev = 0
+	for i, name in enumerate(MILESTONES):
+		if ms[i] is None:
+			print(f"{name:16s}        -")
+			continue
+		print(f"{name:16s} {ms[i] / CLK_FREQ * 1e3:8.3f} ms  (+{(ms[i] - prev) / CLK_FREQ * 1e3:.3f} ms)")
+		prev = ms[i]
+
+	print(f"{'Now':16s} {now / CLK_FREQ * 1e3:8.3f} ms")
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
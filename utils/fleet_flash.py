@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+#
+# Flash the same image on many bootloader devices in parallel
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import concurrent.futures
+import json
+import sys
+import threading
+import time
+
+from no2bootloader import NO2Bootloader, OpStats, find_devices
+from no2image import load_image
+
+
+class FleetProgress:
+
+	def __init__(self, serials, stream=sys.stderr):
+		self.state  = { s: 0 for s in serials }
+		self.lock   = threading.Lock()
+		self.stream = stream
+		self.last   = 0
+
+	def update(self, serial, done, total):
+		with self.lock:
+			self.state[serial] = (100 * done // total) if total else 100
+
+			# Don't spend our time printing
+			now = time.monotonic()
+			if (now - self.last) < 0.1 and done != total:
+				return
+			self.last = now
+
+			self.stream.write('\r' + ' '.join([f"{(s or '????')[-4:]}:{p:3d}%" for s, p in self.state.items()]))
+			self.stream.flush()
+
+	def finish(self):
+		self.stream.write('\n')
+
+
+def flash_one(bl, segments, progress):
+	bl.stats.reset()
+	t0 = time.monotonic()
+	bl.flash_write_segments(segments, lambda op, a, done, total: progress.update(bl.serial, done, total))
+	return time.monotonic() - t0
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Flash an image on several no2bootloader devices in parallel')
+	parser.add_argument('image', help='Binary image (dense or sparse) to flash')
+	parser.add_argument('addr', nargs='?', default='0', help='Flash address (sector aligned)')
+	parser.add_argument('-s', '--serial', action='append', help='Only flash the device with this serial (flash unique ID), can be repeated')
+	parser.add_argument('-j', '--jobs', type=int, default=0, help='Maximum number of devices flashed concurrently (default: all)')
+	parser.add_argument('--vid', type=lambda x: int(x, 0), default=0x1d50)
+	parser.add_argument('--pid', type=lambda x: int(x, 0), default=0x6146)
+	parser.add_argument('--emulate', type=int, default=0, metavar='N', help='Use N emulated devices instead of real hardware')
+	parser.add_argument('--stats', action='store_true', help='Print per operation timing statistics, summed over all devices')
+	parser.add_argument('--json', metavar='FILE', help='Write per device and total timing statistics to this JSON file')
+	args = parser.parse_args()
+
+	addr = int(args.addr, 0)
+	if addr & 4095:
+		raise RuntimeError('Address must be sector aligned !')
+
+	segments = load_image(args.image, addr)
+	size = sum([len(d) for a, d in segments])
+
+	# Enumerate
+	if args.emulate:
+		from no2emu import emulated_devices
+		devs = emulated_devices(args.emulate)
+	else:
+		devs = find_devices(args.vid, args.pid)
+
+	bls = [NO2Bootloader(dev=d) for d in devs]
+
+	if args.serial:
+		bls = [bl for bl in bls if bl.serial in args.serial]
+		missing = set(args.serial) - set([bl.serial for bl in bls])
+		if missing:
+			raise RuntimeError('Device(s) not found: ' + ', '.join(sorted(missing)))
+
+	if not bls:
+		raise RuntimeError('No device found')
+
+	print(f"Flashing {size} bytes in {len(segments)} segment(s) on {len(bls)} device(s)", file=sys.stderr)
+
+	# Run
+	progress = FleetProgress([bl.serial for bl in bls])
+	results = {}
+	t0 = time.monotonic()
+
+	with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs or len(bls)) as pool:
+		futures = { pool.submit(flash_one, bl, segments, progress): bl.serial for bl in bls }
+		for f in concurrent.futures.as_completed(futures):
+			try:
+				results[futures[f]] = f.result()
+			except Exception as e:
+				results[futures[f]] = e
+
+	progress.finish()
+	t = time.monotonic() - t0
+
+	# Report
+	ok = 0
+	for s, r in sorted(results.items()):
+		if isinstance(r, Exception):
+			print(f"{s}: FAILED ({r})", file=sys.stderr)
+		else:
+			print(f"{s}: {r:.2f} s, {size / r / 1024:.1f} KiB/s", file=sys.stderr)
+			ok += 1
+
+	print(f"Total: {ok}/{len(bls)} ok in {t:.2f} s, aggregate {ok * size / t / 1024:.1f} KiB/s", file=sys.stderr)
+
+	total = OpStats()
+	for bl in bls:
+		total.merge(bl.stats)
+
+	if args.stats:
+		print(total.summary(t), file=sys.stderr)
+
+	if args.json:
+		with open(args.json, 'w') as fh:
+			json.dump({
+				'size':    size,
+				'elapsed': t,
+				'devices': {
+					bl.serial: dict(bl.stats.as_dict(), ok=not isinstance(results.get(bl.serial), Exception))
+					for bl in bls
+				},
+				'total': total.as_dict(t),
+			}, fh, indent='\t', sort_keys=True)
+			fh.write('\n')
+
+	return 0 if ok == len(bls) else 1
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Build a combined DFU image, holding several zones, to be downloaded in
+# a single DFU session to the "Combined image" alt setting
+#
+# Format : a sequence of records, each one is a 256 bytes header page
+# followed by the payload padded to a multiple of 256 bytes :
+#
+#   <4sB3xII : magic 'no2R', zone, offset (4k aligned), length
+#
+# Zones are the DFU zones indexes of the bootloader, same as the alt
+# settings numbers, which are stable. The bootloader ones are only
+# accepted when the flash is unlocked and 'data' only exists in builds
+# with DFU_DATA_START.
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import struct
+import sys
+
+
+CMB_MAGIC = b'no2R'
+PAGE_SIZE = 256
+
+ZONES = {
+	'fpga':      0,
+	'riscv':     1,
+	'bl_fpga':   2,
+	'bl_riscv':  3,
+	'fpga_b':    4,
+	'riscv_b':   5,
+	'data':      7,
+}
+
+
+def pad(data, align=PAGE_SIZE):
+	return data + b'\xff' * (-len(data) % align)
+
+
+def pack(records):
+	"""Build the combined image from a list of (zone, offset, data)"""
+	out = bytearray()
+	for zone, offset, data in records:
+		if offset & 4095:
+			raise ValueError('Record offset must be sector aligned')
+
+		# Trailing 0xff don't need to be sent, the sectors are erased
+		data = data[:(len(data.rstrip(b'\xff')) + 3) & ~3]
+		out += pad(struct.pack('<4sB3xII', CMB_MAGIC, zone, offset, len(data)))
+		out += pad(data)
+	return bytes(out)
+
+
+def parse_zone(s):
+	return ZONES[s] if s in ZONES else int(s, 0)
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Build a combined multi-zone DFU image')
+	parser.add_argument('output', help='Output file')
+	parser.add_argument('records', nargs='+', metavar='ZONE=FILE[@OFFSET]',
+		help='Zone (' + ', '.join(ZONES.keys()) + ' or number), file and optional offset in the zone')
+	args = parser.parse_args()
+
+	records = []
+	for r in args.records:
+		zone, fn = r.split('=', 1)
+		offset = 0
+		if '@' in fn:
+			fn, offset = fn.rsplit('@', 1)
+			offset = int(offset, 0)
+		with open(fn, 'rb') as fh:
+			records.append( (parse_zone(zone), offset, fh.read()) )
+
+	with open(args.output, 'wb') as fh:
+		fh.write(pack(records))
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
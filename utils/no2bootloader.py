@@ -1,27 +1,129 @@
 #!/usr/bin/env python3
 
+import contextlib
 import sys
+import time
+import zlib
 
 import usb.core
+import usb.util
+
+
+def find_devices(vid=0x1d50, pid=0x6146):
+	"""Return the list of all the connected bootloader devices"""
+	return list(usb.core.find(find_all=True, idVendor=vid, idProduct=pid))
+
+
+class OpStats:
+	"""Count, total / max duration and bytes per operation type.
+
+	Operations nest : an erase includes its busy polls, which themselves
+	are USB transfers. So times of different types don't add up"""
+
+	def __init__(self):
+		self.reset()
+
+	def reset(self):
+		self.ops = {}
+		self.t0  = time.monotonic()
+
+	def add(self, op, t, nbytes=0):
+		s = self.ops.setdefault(op, { 'count': 0, 'time': 0.0, 'max': 0.0, 'bytes': 0 })
+		s['count'] += 1
+		s['time']  += t
+		s['max']    = max(s['max'], t)
+		s['bytes'] += nbytes
+
+	@contextlib.contextmanager
+	def measure(self, op, nbytes=0):
+		t0 = time.monotonic()
+		try:
+			yield
+		finally:
+			self.add(op, time.monotonic() - t0, nbytes)
+
+	def merge(self, other):
+		for op, o in other.ops.items():
+			s = self.ops.setdefault(op, { 'count': 0, 'time': 0.0, 'max': 0.0, 'bytes': 0 })
+			s['count'] += o['count']
+			s['time']  += o['time']
+			s['max']    = max(s['max'], o['max'])
+			s['bytes'] += o['bytes']
+
+	def as_dict(self, elapsed=None):
+		return { 'elapsed': elapsed or (time.monotonic() - self.t0), 'ops': self.ops }
+
+	def summary(self, elapsed=None):
+		lines = [ f"{'op':12s} {'count':>7s} {'total':>9s} {'avg':>9s} {'max':>9s} {'KiB/s':>8s}" ]
+		for op, s in sorted(self.ops.items()):
+			rate = (s['bytes'] / s['time'] / 1024) if (s['bytes'] and s['time']) else None
+			lines.append(
+				f"{op:12s} {s['count']:7d} {s['time']:8.3f}s {s['time'] / s['count'] * 1e3:7.2f}ms " +
+				f"{s['max'] * 1e3:7.2f}ms " + (f"{rate:8.1f}" if rate else f"{'-':>8s}")
+			)
+		lines.append(f"elapsed {elapsed or (time.monotonic() - self.t0):.3f}s")
+		return '\n'.join(lines)
 
 
 class NO2Bootloader:
 
 	POLL = 0.010	# 10 ms
 
-	def __init__(self, vid=0x1d50, pid=0x6146):
+	PATCH_MAX   = 256
+	MAP_MAX     = 256
+	TRACE_CHUNK = 64
+	PATCH_RESULT = { 2: 'bad address', 3: 'verify failed', 4: 'erase not supported' }
+
+	# Above 16M, the 4 byte address opcodes are used. They don't depend on
+	# any mode so small offsets still use the 3 bytes ones.
+	OPS_4B = {
+		0x02: 0x12,		# Page Program
+		0x03: 0x13,		# Read
+		0x20: 0x21,		# Sector Erase (4k)
+		0x52: 0x5c,		# Block Erase (32k)
+		0xd8: 0xdc,		# Block Erase (64k)
+	}
+
+	def __init__(self, vid=0x1d50, pid=0x6146, serial=None, dev=None):
 
-		self.dev = usb.core.find(idVendor=vid, idProduct=pid)
-		if self.dev is None:
+		if dev is None:
+			for d in find_devices(vid, pid):
+				if (serial is None) or (self._get_serial(d) == serial):
+					dev = d
+					break
+
+		if dev is None:
 			raise RuntimeError('Device not found')
 
+		self.dev = dev
 		self.dev.set_configuration()
 
+		self.stats = OpStats()
+
 		if self.get_version() != (1, 0):
 			raise RuntimeError('Unknown version')
 
+		self.serial = self._get_serial(self.dev)
+
+	def _ctrl_transfer(self, bmRequestType, bRequest, wValue, wIndex, data_or_wLength, timeout=None):
+		t0 = time.monotonic()
+		r = self.dev.ctrl_transfer(bmRequestType, bRequest, wValue, wIndex, data_or_wLength, timeout)
+		if bmRequestType & 0x80:
+			self.stats.add('usb_in', time.monotonic() - t0, len(r))
+		else:
+			self.stats.add('usb_out', time.monotonic() - t0, len(data_or_wLength))
+		return r
+
+	@staticmethod
+	def _get_serial(dev):
+		# The bootloader reports the flash unique ID as serial number
+		try:
+			return dev.serial_number
+		except (ValueError, usb.core.USBError):
+			return None
+
 	def get_version(self):
-		resp = self.dev.ctrl_transfer(
+		resp = self._ctrl_transfer(
 			0xc1,	# bmRequestType
 			0,		# bRequest,
 			0,		# wValue=0,
@@ -34,7 +136,7 @@ class NO2Bootloader:
 	def spi_exec(self, cmd, rlen=0):
 		# Execute command
 		buf = cmd + (b'\x00' * rlen)
-		self.dev.ctrl_transfer(
+		self._ctrl_transfer(
 			0x41,	# bmRequestType
 			1,		# bRequest,
 			0,		# wValue=0,
@@ -44,7 +146,7 @@ class NO2Bootloader:
 		)
 
 		# Get result
-		buf = self.dev.ctrl_transfer(
+		buf = self._ctrl_transfer(
 			0xc1,		# bmRequestType
 			2,			# bRequest,
 			0,			# wValue=0,
@@ -55,31 +157,251 @@ class NO2Bootloader:
 
 		return bytes(buf[len(cmd):])
 
+	def get_boot_trace(self):
+		"""Returns (milestones, now). Each milestone is a 24 MHz timestamp
+		relative to reset release or None if it wasn't reached (yet)"""
+		buf = bytes(self._ctrl_transfer(
+			0xc1,	# bmRequestType
+			0x10,	# bRequest,
+			0,		# wValue=0,
+			0,		# wIndex=0,
+			36,		# data_or_wLength=None,
+			None	# timeout=None,
+		))
+		v = [int.from_bytes(buf[i:i+4], 'little') for i in range(0, 36, 4)]
+		return [(x & 0x7fffffff) if (x & 0x80000000) else None for x in v[0:8]], v[8]
+
+	def spi_trace_ctrl(self, enable, oneshot=True, clear=True):
+		"""Start / stop the SPI traffic capture. Only does something with
+		the SPI_TRACE=1 gateware"""
+		self._ctrl_transfer(
+			0x41,	# bmRequestType
+			0x15,	# bRequest,
+			(int(oneshot) << 2) | (int(enable) << 1) | int(clear),
+			0,		# wIndex=0,
+			b'',	# data_or_wLength=None,
+			None	# timeout=None,
+		)
+
+	def get_spi_trace(self):
+		"""Returns (entries, elapsed) : the raw 32 bits capture entries,
+		oldest first (see gateware/ice40/rtl/spi_trace.v) and the capture
+		time in 24 MHz cycles. None if the gateware doesn't have it"""
+		def read(ofs, n):
+			r = bytes(self._ctrl_transfer(0xc1, 0x15, ofs, 0, 12 + 4 * n, None))
+			return [int.from_bytes(r[i:i+4], 'little') for i in range(0, len(r), 4)]
+
+		csr, wptr, elapsed = read(0, 0)[0:3]
+		if not (csr & (1 << 31)):
+			return None
+
+		full = bool(csr & (1 << 30))
+		n = (1 << ((csr >> 16) & 0xff)) if full else wptr
+
+		entries = []
+		while len(entries) < n:
+			entries.extend(read(len(entries), min(n - len(entries), self.TRACE_CHUNK))[3:])
+
+		# Ring mode : oldest entry is the next one to be written
+		if full:
+			entries = entries[wptr:] + entries[:wptr]
+
+		return entries, elapsed
+
+
+	@classmethod
+	def _addr_cmd(cls, op, addr):
+		if addr >= (1 << 24):
+			return bytes([cls.OPS_4B[op]]) + addr.to_bytes(4, 'big')
+		return bytes([op]) + addr.to_bytes(3, 'big')
 
 	def flash_busy(self):
-		return bool(self.spi_exec(b'\x05', 1)[0] & 1)
+		with self.stats.measure('busy_poll'):
+			return bool(self.spi_exec(b'\x05', 1)[0] & 1)
 
-	def flash_erase_4k(self, addr):
-		# Write enable
-		self.spi_exec(b'\x06')
+	def flash_erase(self, addr, size=4096):
+		op = { 4096: 0x20, 32768: 0x52, 65536: 0xd8 }[size]
+
+		with self.stats.measure('erase', size):
+			# Write enable
+			self.spi_exec(b'\x06')
 
-		# Erase 4k
-		self.spi_exec(b'\x20' + addr.to_bytes(3, 'big'))
+			# Erase
+			self.spi_exec(self._addr_cmd(op, addr))
 
-		# Wait until flash is ready
-		while self.flash_busy():
-			pass
+			# Wait until flash is ready
+			while self.flash_busy():
+				pass
+
+	def flash_erase_4k(self, addr):
+		self.flash_erase(addr, 4096)
 
 	def flash_program_page(self, addr, data):
-		# Write enable
-		self.spi_exec(b'\x06')
+		with self.stats.measure('program', len(data)):
+			# Write enable
+			self.spi_exec(b'\x06')
 
-		# Write page
-		self.spi_exec(b'\x02' + addr.to_bytes(3, 'big') + data)
+			# Write page
+			self.spi_exec(self._addr_cmd(0x02, addr) + data)
 
-		# Wait until flash is ready
-		while self.flash_busy():
-			pass
+			# Wait until flash is ready
+			while self.flash_busy():
+				pass
 
 	def flash_read(self, addr, l):
-		return self.spi_exec(b'\x03' + addr.to_bytes(3, 'big'), l)
+		with self.stats.measure('read', l):
+			return self.spi_exec(self._addr_cmd(0x03, addr), l)
+
+	def flash_write(self, addr, data, progress=None):
+		"""Erase and program `data` at the sector aligned `addr`.
+		`progress(op, addr, done, total)` is called before each operation"""
+		if addr & 4095:
+			raise RuntimeError('Address must be sector aligned !')
+
+		for ofs in range(0, len(data), 256):
+			if ofs & 4095 == 0:
+				if progress:
+					progress('erase', addr + ofs, ofs, len(data))
+				self.flash_erase_4k(addr + ofs)
+
+			chunk = data[ofs:ofs+256]
+			if len(chunk) < 256:
+				chunk = chunk + b'\x00' * (256 - len(chunk))
+
+			if progress:
+				progress('program', addr + ofs, ofs, len(data))
+			self.flash_program_page(addr + ofs, chunk)
+
+		if progress:
+			progress('done', addr + len(data), len(data), len(data))
+
+	def flash_patch(self, addr, data):
+		"""Byte granular write of `data` at `addr`, any alignment. The device
+		merges it into the affected sectors and only erases / programs what
+		actually changed. Returns the number of (skipped, programmed without
+		erase, erased) sectors"""
+		res = [0, 0, 0]
+
+		for ofs in range(0, len(data), self.PATCH_MAX):
+			chunk = data[ofs:ofs+self.PATCH_MAX]
+
+			with self.stats.measure('patch', len(chunk)):
+				self._ctrl_transfer(
+					0x41,	# bmRequestType
+					0x13,	# bRequest,
+					0,		# wValue=0,
+					0,		# wIndex=0,
+					(addr + ofs).to_bytes(4, 'little') + chunk,
+					None	# timeout=None,
+				)
+
+				while True:
+					r = bytes(self._ctrl_transfer(0xc1, 0x13, 0, 0, 4, None))
+					if r[0] != 1:	# Busy
+						break
+					time.sleep(self.POLL)
+
+			if r[0]:
+				raise RuntimeError(f"Patch @0x{addr + ofs:08x} failed ({self.PATCH_RESULT.get(r[0], r[0])})")
+
+			res = [ a + b for a, b in zip(res, r[1:4]) ]
+
+		return tuple(res)
+
+	def flash_sector_crcs(self, addr, n):
+		"""CRC32 (zlib) of the `n` 4k sectors starting at `addr`, computed
+		by the device"""
+		crcs = []
+
+		while len(crcs) < n:
+			cnt = min(n - len(crcs), self.MAP_MAX)
+			a   = addr + 4096 * len(crcs)
+
+			with self.stats.measure('sector_map', 4096 * cnt):
+				self._ctrl_transfer(
+					0x41,	# bmRequestType
+					0x14,	# bRequest,
+					0,		# wValue=0,
+					0,		# wIndex=0,
+					a.to_bytes(4, 'little') + cnt.to_bytes(4, 'little'),
+					None	# timeout=None,
+				)
+
+				while True:
+					r = bytes(self._ctrl_transfer(0xc1, 0x14, 0, 0, 8 + 4 * cnt, None))
+					rn, done = int.from_bytes(r[0:4], 'little'), int.from_bytes(r[4:8], 'little')
+					if rn != cnt:
+						raise RuntimeError(f"Sector map @0x{a:08x} refused")
+					if done == cnt:
+						break
+					time.sleep(self.POLL)
+
+			crcs.extend([int.from_bytes(r[i:i+4], 'little') for i in range(8, 8 + 4 * cnt, 4)])
+
+		return crcs
+
+	def flash_write_delta(self, segments, progress=None):
+		"""Like flash_write_segments() but only for the sectors whose
+		content differs from the image (sectors are compared as they'd be
+		after a full write, i.e. padded with 0xff). Returns the number of
+		(changed, total) sectors"""
+		# Expected content of every touched sector
+		sectors = {}
+		for addr, data in segments:
+			a = addr
+			while a < addr + len(data):
+				s = a & ~4095
+				l = min(s + 4096, addr + len(data)) - a
+				buf = sectors.setdefault(s, bytearray(b'\xff' * 4096))
+				buf[a-s:a-s+l] = data[a-addr:a-addr+l]
+				a += l
+
+		# Compare against the device, one request per contiguous run
+		changed = []
+		keys = sorted(sectors)
+		while keys:
+			n = 1
+			while (n < len(keys)) and (keys[n] == keys[0] + 4096 * n):
+				n += 1
+			run, keys = keys[:n], keys[n:]
+			for s, crc in zip(run, self.flash_sector_crcs(run[0], n)):
+				if zlib.crc32(sectors[s]) != crc:
+					changed.append( (s, bytes(sectors[s])) )
+
+		if changed:
+			self.flash_write_segments(changed, progress)
+
+		return len(changed), len(sectors)
+
+	def flash_write_segments(self, segments, progress=None):
+		"""Erase and program only the populated (address, data) `segments`,
+		merging erases into the largest possible units"""
+		from no2image import plan_erase
+
+		plan  = plan_erase(segments)
+		total = sum([sz for a, sz in plan]) + sum([len(d) for a, d in segments])
+		done  = 0
+
+		for a, sz in plan:
+			if progress:
+				progress('erase', a, done, total)
+			self.flash_erase(a, sz)
+			done += sz
+
+		for addr, data in segments:
+			while len(data):
+				# Up to the end of the page
+				l = 256 - (addr & 0xff)
+				chunk, data = data[:l], data[l:]
+
+				# Erased flash is already all 1s
+				if chunk.count(0xff) != len(chunk):
+					if progress:
+						progress('program', addr, done, total)
+					self.flash_program_page(addr, chunk)
+
+				addr += len(chunk)
+				done += len(chunk)
+
+		if progress:
+			progress('done', 0, total, total)
@@ -0,0 +1,428 @@
+#!/usr/bin/env python3
+#
+# Native DFU client for the no2bootloader
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import re
+import struct
+import sys
+import time
+
+import usb.core
+import usb.util
+
+
+# DFU requests
+DFU_DETACH    = 0
+DFU_DNLOAD    = 1
+DFU_UPLOAD    = 2
+DFU_GETSTATUS = 3
+DFU_CLRSTATUS = 4
+DFU_GETSTATE  = 5
+DFU_ABORT     = 6
+
+# DFU states
+ST_APP_IDLE           = 0
+ST_APP_DETACH         = 1
+ST_DFU_IDLE           = 2
+ST_DFU_DNLOAD_SYNC    = 3
+ST_DFU_DNBUSY         = 4
+ST_DFU_DNLOAD_IDLE    = 5
+ST_DFU_MANIFEST_SYNC  = 6
+ST_DFU_MANIFEST       = 7
+ST_DFU_MANIFEST_WAIT  = 8
+ST_DFU_UPLOAD_IDLE    = 9
+ST_DFU_ERROR          = 10
+
+USB_DFU_DT_FUNC = 0x21
+
+# Short zone names, same as utils/mkcombined.py. The bootloader alt
+# settings numbers are stable
+ZONE_ALIASES = {
+	'fpga':      0,
+	'riscv':     1,
+	'bl_fpga':   2,
+	'bl_riscv':  3,
+	'fpga_b':    4,
+	'riscv_b':   5,
+	'combined':  6,
+	'data':      7,
+}
+
+
+class DFUAlt:
+
+	def __init__(self, intf, name, func):
+		self.intf   = intf.bInterfaceNumber
+		self.alt    = intf.bAlternateSetting
+		self.name   = name or ''
+
+		# Functional descriptor
+		(	self.bmAttributes,
+			self.wDetachTimeOut,
+			self.wTransferSize,
+			self.bcdDFUVersion
+		) = struct.unpack('<BHHH', func[2:9]) if func else (0, 0, 4096, 0x0101)
+
+	@property
+	def manifestation_tolerant(self):
+		return bool(self.bmAttributes & 4)
+
+	def __repr__(self):
+		return f"alt={self.alt} name=\"{self.name}\" xfer={self.wTransferSize}"
+
+
+class DFUPoller:
+	"""Estimates how long the device stays busy after each block so that we
+	wait about the right amount before polling instead of the fixed (and
+	usually pessimistic) bwPollTimeout"""
+
+	def __init__(self, alpha=0.25, margin=0.8, poll=0.001):
+		self.est    = None
+		self.alpha  = alpha
+		self.margin = margin
+		self.poll   = poll
+
+	def first_wait(self, bwPollTimeout):
+		if self.est is None:
+			return bwPollTimeout
+		return min(bwPollTimeout, self.est * self.margin)
+
+	def update(self, t):
+		self.est = t if self.est is None else ((1 - self.alpha) * self.est + self.alpha * t)
+
+
+class DFUDevice:
+
+	def __init__(self, vid=0x1d50, pid=0x6146, serial=None, dev=None, timeout=5000):
+		if dev is None:
+			dev = find_device(vid, pid, serial)
+
+		if dev is None:
+			raise RuntimeError('Device not found')
+
+		self.dev = dev
+		self.timeout = timeout
+		self.stats = []
+		self.erase_ahead = True
+
+		self.dev.set_configuration()
+		self.alts = self._scan_alts()
+		self.cur_alt = None
+
+	def _scan_alts(self):
+		alts = []
+		for intf in self.dev.get_active_configuration():
+			if (intf.bInterfaceClass, intf.bInterfaceSubClass) != (0xfe, 0x01):
+				continue
+
+			# Find functional descriptor in the extra descriptors
+			func = None
+			extra = bytes(intf.extra_descriptors)
+			while len(extra) >= 2:
+				if extra[1] == USB_DFU_DT_FUNC:
+					func = extra[0:extra[0]]
+				extra = extra[extra[0]:]
+
+			name = usb.util.get_string(self.dev, intf.iInterface) if intf.iInterface else None
+			alts.append(DFUAlt(intf, name, func))
+
+		return alts
+
+	def find_alt(self, sel):
+		# Numeric alt setting or short name
+		try:
+			n = ZONE_ALIASES[sel] if sel in ZONE_ALIASES else int(sel, 0)
+			for a in self.alts:
+				if a.alt == n:
+					return a
+		except ValueError:
+			pass
+
+		# Exact name, then unique case-insensitive substring
+		for a in self.alts:
+			if a.name == sel:
+				return a
+
+		m = [a for a in self.alts if sel.lower() in a.name.lower()]
+		if len(m) == 1:
+			return m[0]
+		elif len(m) > 1:
+			raise RuntimeError(f"Zone name '{sel}' is ambiguous: " + ', '.join([repr(a.name) for a in m]))
+
+		raise RuntimeError(f"Zone '{sel}' not found")
+
+	def select(self, alt):
+		if self.cur_alt is not alt:
+			self.dev.set_interface_altsetting(alt.intf, alt.alt)
+			self.cur_alt = alt
+
+	# Raw requests
+	def _out(self, req, wValue=0, data=None):
+		return self.dev.ctrl_transfer(0x21, req, wValue, self.cur_alt.intf, data, self.timeout)
+
+	def _in(self, req, wValue, l):
+		return self.dev.ctrl_transfer(0xa1, req, wValue, self.cur_alt.intf, l, self.timeout)
+
+	def set_erase_ahead(self, length):
+		# Firmware vendor request (no2bootloader specific) : length of the
+		# next download, the bootloader never erases ahead past it (0 = off)
+		self.dev.ctrl_transfer(0x41, 0x11, min((length + 4095) >> 12, 0xffff), 0, None, self.timeout)
+
+	def get_combined_status(self):
+		# Firmware vendor request (no2bootloader specific)
+		r = bytes(self.dev.ctrl_transfer(0xc1, 0x12, 0, 0, 8, self.timeout))
+		return r[0], r[1], int.from_bytes(r[4:8], 'little')
+
+	def get_status(self):
+		r = self._in(DFU_GETSTATUS, 0, 6)
+		status  = r[0]
+		timeout = (r[1] | (r[2] << 8) | (r[3] << 16)) / 1000.0
+		state   = r[4]
+		return status, timeout, state
+
+	def clear_status(self):
+		self._out(DFU_CLRSTATUS)
+
+	def abort(self):
+		self._out(DFU_ABORT)
+
+	def detach(self):
+		try:
+			self._out(DFU_DETACH, 1000)
+		except usb.core.USBError:
+			# Device might already be gone
+			pass
+
+	def _ensure_idle(self):
+		status, _, state = self.get_status()
+		if state == ST_DFU_ERROR:
+			self.clear_status()
+		elif state != ST_DFU_IDLE:
+			self.abort()
+		status, _, state = self.get_status()
+		if state != ST_DFU_IDLE:
+			raise RuntimeError(f'Unable to get device to idle state ({state})')
+
+	def _wait_ready(self, poller, final_states):
+		t0 = time.monotonic()
+		n_poll = 0
+
+		status, bwPollTimeout, state = self.get_status()
+		n_poll += 1
+		wait = poller.first_wait(bwPollTimeout)
+
+		while state not in final_states:
+			if state == ST_DFU_ERROR:
+				raise RuntimeError(f'Device error (status {status})')
+
+			time.sleep(wait)
+			status, bwPollTimeout, state = self.get_status()
+			n_poll += 1
+			wait = min(poller.poll, bwPollTimeout)
+
+		poller.update(time.monotonic() - t0)
+
+		return n_poll
+
+	# High level
+	def download(self, alt, data, trim=True):
+		self.select(alt)
+		self._ensure_idle()
+
+		if trim:
+			data = trim_padding(data)
+
+		self.set_erase_ahead(len(data) if self.erase_ahead else 0)
+
+		poller = DFUPoller()
+		bs = alt.wTransferSize
+		n_poll = 0
+		t0 = time.monotonic()
+
+		# Send all blocks
+		for blk, ofs in enumerate(range(0, len(data), bs)):
+			self._out(DFU_DNLOAD, blk, data[ofs:ofs+bs])
+			n_poll += self._wait_ready(poller, (ST_DFU_DNLOAD_IDLE,))
+
+		# End of transfer
+		self._out(DFU_DNLOAD, (len(data) + bs - 1) // bs, None)
+		n_poll += self._wait_ready(poller, (ST_DFU_IDLE, ST_DFU_MANIFEST_WAIT))
+
+		t = time.monotonic() - t0
+
+		# Combined images errors can only be reported out of band
+		if alt.name and alt.name.startswith('Combined'):
+			err, n_rec, remain = self.get_combined_status()
+			if err or remain:
+				raise RuntimeError(f'Combined image rejected (error {err}, after {n_rec} records, {remain} bytes missing)')
+
+		self.stats.append( (alt, len(data), t, n_poll, poller.est or 0) )
+
+		return t
+
+	def upload(self, alt, length=None):
+		self.select(alt)
+		self._ensure_idle()
+
+		bs = alt.wTransferSize
+		data = bytearray()
+		blk = 0
+
+		while True:
+			l = bs if length is None else min(bs, length - len(data))
+			d = self._in(DFU_UPLOAD, blk, l) if l else b''
+			data += d
+			blk += 1
+			if len(d) < bs:
+				break
+
+		if len(d) == bs:
+			self.abort()
+
+		return bytes(data)
+
+	def print_stats(self, stream=sys.stderr):
+		t_tot = 0
+		for alt, l, t, n_poll, est in self.stats:
+			print(f"{alt.name:32s} {l:8d} bytes  {t:6.2f} s  {l / t / 1024 if t else 0:7.1f} KiB/s  {n_poll:4d} polls  {est * 1000:6.1f} ms/block", file=stream)
+			t_tot += t
+		print(f"{'Total':32s} {sum([s[1] for s in self.stats]):8d} bytes  {t_tot:6.2f} s", file=stream)
+
+
+def find_device(vid, pid, serial=None):
+	for d in usb.core.find(find_all=True, idVendor=vid, idProduct=pid):
+		if (serial is None) or (d.serial_number == serial):
+			return d
+	return None
+
+
+def usb_location(dev):
+	try:
+		return (dev.bus, tuple(dev.port_numbers or ()))
+	except (AttributeError, NotImplementedError, usb.core.USBError):
+		return None
+
+
+def detach_app(vid, pid, serial=None, bl=(0x1d50, 0x6146), timeout=10.0):
+	"""Switch a running application to the bootloader through its DFU
+	runtime interface (see firmware/app/dfu_rt.c). Returns the bootloader
+	device once it enumerated, None if no application was found.
+	`serial` selects the application, the bootloader reports the flash
+	UID instead so it's found as the one that appears on the same port
+	(or, if the backend doesn't tell, the one that wasn't there before)"""
+	dev = find_device(vid, pid, serial)
+	if dev is None:
+		return None
+
+	loc = usb_location(dev)
+	before = set([(d.bus, d.address) for d in usb.core.find(find_all=True, idVendor=bl[0], idProduct=bl[1])])
+
+	intf = None
+	for i in dev.get_active_configuration():
+		if (i.bInterfaceClass, i.bInterfaceSubClass, i.bInterfaceProtocol) == (0xfe, 0x01, 0x01):
+			intf = i.bInterfaceNumber
+			break
+
+	if intf is None:
+		raise RuntimeError('Application has no DFU runtime interface')
+
+	try:
+		dev.ctrl_transfer(0x21, DFU_DETACH, 1000, intf, None, 1000)
+	except usb.core.USBError:
+		# Might reboot before the status stage
+		pass
+
+	usb.util.dispose_resources(dev)
+
+	# Wait for the bootloader to show up
+	t_end = time.monotonic() + timeout
+	while time.monotonic() < t_end:
+		time.sleep(0.1)
+		for d in usb.core.find(find_all=True, idVendor=bl[0], idProduct=bl[1]):
+			if (d.bus, d.address) in before:
+				continue
+			if loc and loc[1] and (usb_location(d) != loc):
+				continue
+			return d
+
+	raise RuntimeError('Bootloader did not enumerate after detach')
+
+
+def trim_padding(data, pad=b'\xff', align=4):
+	"""Drop the trailing erased-flash padding. The sector holding the last
+	byte is erased by the device, anything beyond is either untouched or
+	erased"""
+	l = len(data.rstrip(pad))
+	l = (l + align - 1) & ~(align - 1)
+	return data[:l]
+
+
+def main():
+	parser = argparse.ArgumentParser(description='no2bootloader DFU client')
+	parser.add_argument('images', nargs='*', metavar='ZONE=FILE', help='Zone (alt setting number, short name like fpga / riscv, or name) and image to download')
+	parser.add_argument('-d', '--device', default='1d50:6146', help='vid:pid')
+	parser.add_argument('-S', '--serial', help='Serial number of the device to use (of the application with -a)')
+	parser.add_argument('-a', '--app', metavar='VID:PID', help='If the bootloader is not there, detach this application to it first')
+	parser.add_argument('-l', '--list', action='store_true', help='List the available zones')
+	parser.add_argument('-R', '--reset', action='store_true', help='Reboot to the application when done')
+	parser.add_argument('--no-trim', action='store_true', help='Send the images as-is, including trailing padding')
+	parser.add_argument('--erase-ahead', choices=['on', 'off'], help='Enable (default) / Disable the background erase in the bootloader')
+	parser.add_argument('--bench', action='store_true', help='Download each image with erase ahead off, then on, and compare')
+	args = parser.parse_args()
+
+	vid, pid = [int(x, 16) for x in args.device.split(':')]
+	dev = find_device(vid, pid, args.serial)
+
+	if (dev is None) and args.app:
+		avid, apid = [int(x, 16) for x in args.app.split(':')]
+		print("Detaching application to the bootloader", file=sys.stderr)
+		dev = detach_app(avid, apid, args.serial, bl=(vid, pid))
+
+	dfu = DFUDevice(vid, pid, args.serial, dev=dev)
+
+	if args.list:
+		for a in dfu.alts:
+			print(a)
+
+	# Resolve everything before starting
+	jobs = []
+	for img in args.images:
+		zone, fn = img.split('=', 1)
+		with open(fn, 'rb') as fh:
+			jobs.append( (dfu.find_alt(zone), fh.read()) )
+
+	if args.erase_ahead:
+		dfu.erase_ahead = (args.erase_ahead == 'on')
+
+	# Benchmark
+	if args.bench:
+		for alt, data in jobs:
+			t = {}
+			for ea in [False, True]:
+				dfu.erase_ahead = ea
+				t[ea] = dfu.download(alt, data, trim=not args.no_trim)
+			print(f"{alt.name}: erase ahead off {t[False]:.2f} s, on {t[True]:.2f} s ({t[False] / t[True]:.2f}x)", file=sys.stderr)
+			print(f"BENCH dfu.{re.sub('[^a-z0-9]+', '_', alt.name.lower())}_kibps {len(data) / t[True] / 1024:.1f} higher")
+		jobs = []
+
+	# Download all in the same session
+	for alt, data in jobs:
+		print(f"Downloading {len(data)} bytes to \"{alt.name}\"", file=sys.stderr)
+		dfu.download(alt, data, trim=not args.no_trim)
+
+	if jobs or args.bench:
+		dfu.print_stats()
+
+	if args.reset:
+		dfu.detach()
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#
+# Emulated no2bootloader device, for testing the host tools without hardware
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import threading
+import time
+import zlib
+
+
+class EmulatedBus:
+	"""Shared USB bus : the data phase of transfers is serialized at a fixed
+	bandwidth, the per-transfer scheduling latency is per-device"""
+
+	def __init__(self, bandwidth=800e3, latency=0.001):
+		self.bandwidth = bandwidth	# Usable bytes/s on control transfers
+		self.latency   = latency	# Fixed cost per control transfer
+		self.lock      = threading.Lock()
+
+	def transfer(self, l):
+		time.sleep(self.latency)
+		with self.lock:
+			time.sleep(l / self.bandwidth)
+
+
+class EmulatedDevice:
+	"""Mimics the subset of pyusb's Device used by NO2Bootloader, backed by
+	a SPI flash model with realistic erase / program busy times"""
+
+	T_ERASE_4K  = 0.045
+	T_ERASE_32K = 0.120
+	T_ERASE_64K = 0.150
+	T_PROGRAM   = 0.0007
+
+	def __init__(self, serial, bus=None, size=16*1024*1024):
+		self.serial_number = serial
+		self.bus   = bus or EmulatedBus()
+		self.flash = bytearray(b'\xff' * size)
+		self.sr1   = 0x00
+		self.wel   = False
+		self.busy_until = 0
+		self.result = b''
+		self.patch  = bytes(4)
+		self.map    = bytes(8)
+
+	def set_configuration(self):
+		pass
+
+	def ctrl_transfer(self, bmRequestType, bRequest, wValue=0, wIndex=0, data_or_wLength=None, timeout=None):
+		if bmRequestType & 0x80:
+			self.bus.transfer(data_or_wLength)
+			if bRequest == 0:
+				return bytes([1, 0])
+			elif bRequest == 2:
+				return self.result[:data_or_wLength]
+			elif bRequest == 0x13:
+				return (b'\x01' + self.patch[1:]) if self._busy() else self.patch
+			elif bRequest == 0x14:
+				return self.map[:data_or_wLength]
+		else:
+			self.bus.transfer(len(data_or_wLength))
+			if bRequest == 1:
+				self.result = self._spi_exec(bytes(data_or_wLength))
+				return len(data_or_wLength)
+			elif bRequest == 0x13:
+				self._patch(bytes(data_or_wLength))
+				return len(data_or_wLength)
+			elif bRequest == 0x14:
+				self._map(bytes(data_or_wLength))
+				return len(data_or_wLength)
+
+		raise ValueError('Unsupported request')
+
+	def _busy(self):
+		return time.monotonic() < self.busy_until
+
+	# 4 byte address opcodes and their 3 byte equivalent
+	OPS_4B = { 0x12: 0x02, 0x13: 0x03, 0x21: 0x20, 0x5c: 0x52, 0xdc: 0xd8 }
+
+	def _spi_exec(self, cmd):
+		op = cmd[0]
+		al = 3
+
+		if op in self.OPS_4B:
+			op, al = self.OPS_4B[op], 4
+
+		# Read SR1
+		if op == 0x05:
+			return cmd[0:1] + bytes([self.sr1 | (1 if self._busy() else 0)] * (len(cmd) - 1))
+
+		# Anything else is ignored while busy, like a real flash would
+		if self._busy():
+			return cmd
+
+		if op == 0x06:
+			self.wel = True
+
+		elif op == 0x04:
+			self.wel = False
+
+		elif op == 0x03:
+			addr = int.from_bytes(cmd[1:1+al], 'big')
+			l = len(cmd) - 1 - al
+			return cmd[0:1+al] + bytes(self.flash[addr:addr+l])
+
+		elif op in (0x20, 0x52, 0xd8) and self.wel:
+			size, t = {
+				0x20: ( 4096, self.T_ERASE_4K),
+				0x52: (32768, self.T_ERASE_32K),
+				0xd8: (65536, self.T_ERASE_64K),
+			}[op]
+			addr = int.from_bytes(cmd[1:1+al], 'big') & ~(size - 1)
+			self.flash[addr:addr+size] = b'\xff' * size
+			self.busy_until = time.monotonic() + t
+			self.wel = False
+
+		elif op == 0x02 and self.wel:
+			addr = int.from_bytes(cmd[1:1+al], 'big')
+			for i, b in enumerate(cmd[1+al:]):
+				a = (addr & ~0xff) | ((addr + i) & 0xff)
+				self.flash[a] &= b
+			self.busy_until = time.monotonic() + self.T_PROGRAM
+			self.wel = False
+
+		return cmd
+
+	def _patch(self, req):
+		"""Same sector merge as the firmware, done at once with the busy
+		time of the flash operations it would issue"""
+		addr, data = int.from_bytes(req[0:4], 'little'), req[4:]
+		stats = [0, 0, 0]
+		t = 0
+
+		if self._busy() or (len(data) == 0) or (len(data) > 256):
+			raise ValueError('Request stalled')
+
+		if addr + len(data) > len(self.flash):
+			self.patch = bytes([2, 0, 0, 0])
+			return
+
+		while len(data):
+			sect = addr & ~4095
+			l = min(len(data), sect + 4096 - addr)
+			old = self.flash[addr:addr+l]
+			new, data = data[:l], data[l:]
+
+			if old == new:
+				stats[0] += 1
+			elif all([(n & ~o) == 0 for o, n in zip(old, new)]):
+				stats[1] += 1
+				t += self.T_PROGRAM * (((addr + l - 1) >> 8) - (addr >> 8) + 1)
+				self.flash[addr:addr+l] = new
+			else:
+				stats[2] += 1
+				self.flash[addr:addr+l] = new
+				t += self.T_ERASE_4K + self.T_PROGRAM * sum([
+					self.flash[a:a+256].count(0xff) != 256 for a in range(sect, sect + 4096, 256)
+				])
+
+			addr += l
+
+		self.patch = bytes([0] + stats)
+		self.busy_until = time.monotonic() + t
+
+	def _map(self, req):
+		"""Sector CRCs, computed at once"""
+		addr, n = int.from_bytes(req[0:4], 'little'), int.from_bytes(req[4:8], 'little')
+
+		if (addr & 4095) or (n > 256) or (addr + 4096 * n > len(self.flash)):
+			n = 0
+
+		self.map = n.to_bytes(4, 'little') * 2 + b''.join([
+			zlib.crc32(self.flash[a:a+4096]).to_bytes(4, 'little') for a in range(addr, addr + 4096 * n, 4096)
+		])
+
+
+def emulated_devices(n, bus=None, size=16*1024*1024):
+	"""Create `n` emulated devices sharing the same USB bus"""
+	bus = bus or EmulatedBus()
+	return [EmulatedDevice('%016x' % (0xe6_00_00_00_00_00_00_00 + i), bus, size) for i in range(n)]
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# Flash image loading (dense or sparse) and erase planning
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import struct
+import zlib
+
+
+# See gateware/ice40-stub/sw/mkmultiboot.py for the format description
+SPARSE_MAGIC   = b'no2S'
+SPARSE_VERSION = 1
+
+
+def parse_sparse(raw):
+	magic, version, n, size, table_crc = struct.unpack('<4sHHII', raw[0:16])
+	if (magic != SPARSE_MAGIC) or (version != SPARSE_VERSION):
+		raise ValueError('Not a supported sparse image')
+
+	table = raw[16:16+12*n]
+	if zlib.crc32(table) != table_crc:
+		raise ValueError('Corrupted sparse image segment table')
+
+	segments = []
+	ofs = 16 + 12 * n
+	for i in range(n):
+		o, l, crc = struct.unpack('<III', table[12*i:12*i+12])
+		d = raw[ofs:ofs+l]
+		if (len(d) != l) or (zlib.crc32(d) != crc):
+			raise ValueError(f'Corrupted sparse image segment @0x{o:08x}')
+		segments.append( (o, d) )
+		ofs += l
+
+	return segments
+
+
+def load_image(fn, base=0):
+	"""Returns a list of (flash address, data) segments"""
+	with open(fn, 'rb') as fh:
+		raw = fh.read()
+
+	if raw[0:4] == SPARSE_MAGIC:
+		return [(base + o, d) for o, d in parse_sparse(raw)]
+	else:
+		return [(base, raw)]
+
+
+def plan_erase(segments, sizes=(65536, 32768, 4096)):
+	"""Returns the list of (address, size) erase commands covering all the
+	sectors touched by `segments`, using the largest erase units that
+	don't touch any sector outside of them"""
+	sectors = set()
+	for o, d in segments:
+		sectors.update(range(o >> 12, (o + len(d) + 4095) >> 12))
+
+	plan = []
+	while sectors:
+		s = min(sectors)
+		for sz in sizes:
+			n = sz >> 12
+			if (s % n == 0) and all([(s + i) in sectors for i in range(n)]):
+				break
+		plan.append( (s << 12, sz) )
+		sectors.difference_update(range(s, s + n))
+
+	return plan
@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+#
+# Capture and analyze the SPI flash traffic of the DFU bootloader
+#
+# Needs the gateware built with SPI_TRACE=1 (see rtl/spi_trace.v). Typical
+# use is to start a capture, run whatever operation (dfu-util, one of the
+# flashing tools, ...) and then get the report :
+#
+#   spi_trace.py start
+#   dfu-util -d 1d50:6146 -a 1 -D app.bin
+#   spi_trace.py report -o download.json
+#
+# By default the capture stops once the buffer is full, `--ring` keeps the
+# last entries instead. Traces saved with `-o` can be analyzed again later
+# with `-i`, e.g. to compare them before / after a firmware change.
+#
+# Times are measured at the SB_SPI register interface : a byte lasts from
+# its TXDR write to the RXDR read of its result, gaps are what's in
+# between (CPU / gateware latency and the SB_SPI TLEAD / TTRAIL / TIDLE
+# delays).
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import json
+import sys
+
+from no2bootloader import NO2Bootloader
+
+
+CLK_FREQ = 24e6
+
+# Saturation values of the entry fields
+CS_GAP_MAX   = (1 << 24) - 1
+BYTE_GAP_MAX = (1 << 12) - 1
+BYTE_DUR_MAX = (1 << 11) - 1
+
+OPCODES = {
+	0x01: 'WRSR',
+	0x02: 'PP',
+	0x03: 'READ',
+	0x04: 'WRDI',
+	0x05: 'RDSR1',
+	0x06: 'WREN',
+	0x0b: 'FAST_READ',
+	0x12: 'PP4B',
+	0x13: 'READ4B',
+	0x20: 'SE',
+	0x21: 'SE4B',
+	0x31: 'WRSR2',
+	0x35: 'RDSR2',
+	0x4b: 'RUID',
+	0x50: 'WREN_VSR',
+	0x52: 'BE32K',
+	0x5a: 'SFDP',
+	0x5c: 'BE32K4B',
+	0x75: 'SUSPEND',
+	0x7a: 'RESUME',
+	0x9f: 'JEDEC_ID',
+	0xab: 'WAKE_UP',
+	0xb9: 'POWER_DOWN',
+	0xd8: 'BE64K',
+	0xdc: 'BE64K4B',
+}
+
+
+def us(cycles):
+	return cycles / CLK_FREQ * 1e6
+
+
+def decode(entries):
+	"""Turns the raw entries into a list of commands, each a dict with the
+	CS assert / release times and the (start, end, data) of its bytes.
+	Times are in cycles from the first entry. Bytes before the first CS
+	assert (ring mode) are dropped"""
+	cmds = []
+	cur  = None
+	sat  = 0
+	t    = 0
+
+	for e in entries:
+		if e & (1 << 31):
+			gap, dur = (e >> 11) & 0xfff, e & 0x7ff
+			sat += (gap == BYTE_GAP_MAX) + (dur == BYTE_DUR_MAX)
+			start = t + gap
+			t = start + dur
+			if cur is not None:
+				cur['bytes'].append((start, t, (e >> 23) & 0xff))
+		else:
+			gap = e & 0xffffff
+			sat += (gap == CS_GAP_MAX) and (cur is not None)
+			t += gap
+			asserted = ((e >> 24) & 0xf) != 0xf
+			if cur is not None:
+				cur['end'] = t
+				cmds.append(cur)
+			cur = { 'start': t, 'bytes': [] } if asserted else None
+
+	return [c for c in cmds if c['bytes']], sat
+
+
+def histogram(title, values, unit='cycles'):
+	"""Power of 2 buckets"""
+	print(f"\n{title} ({len(values)})")
+	if not values:
+		return
+
+	buckets = {}
+	for v in values:
+		b = v.bit_length()
+		buckets[b] = buckets.get(b, 0) + 1
+
+	peak = max(buckets.values())
+	for b in range(min(buckets), max(buckets) + 1):
+		n = buckets.get(b, 0)
+		lo, hi = (0, 0) if b == 0 else (1 << (b - 1), (1 << b) - 1)
+		print(f"  {lo:6d} - {hi:6d} {unit} {n:7d} {'#' * ((n * 50 + peak - 1) // peak)}")
+
+
+def report(entries, elapsed, events=False):
+	cmds, sat = decode(entries)
+
+	if not cmds:
+		print("No complete command in the trace")
+		return
+
+	# Gaps
+	lead  = []	# CS assert to first byte
+	inter = []	# Between bytes of a command
+	trail = []	# Last byte to CS release
+	idle  = []	# CS release to next CS assert
+	dur   = []	# Bytes
+
+	for i, c in enumerate(cmds):
+		b = c['bytes']
+		lead.append(b[0][0] - c['start'])
+		trail.append(c['end'] - b[-1][1])
+		inter.extend([b[j][0] - b[j-1][1] for j in range(1, len(b))])
+		dur.extend([x[1] - x[0] for x in b])
+		if i:
+			idle.append(c['start'] - cmds[i-1]['end'])
+
+	# Utilization
+	span    = cmds[-1]['end'] - cmds[0]['start']
+	cs_time = sum([c['end'] - c['start'] for c in cmds])
+	xfer    = sum(dur)
+
+	print(f"Entries  : {len(entries)}, {len(cmds)} commands, {len(dur)} bytes")
+	print(f"Capture  : {us(elapsed) / 1e3:.3f} ms, trace span {us(span) / 1e3:.3f} ms")
+	if sat:
+		print(f"           {sat} saturated gaps / durations, times are lower bounds")
+	print(f"Bus busy : {100.0 * xfer / span:5.1f} % of the span (bytes in flight)")
+	print(f"CS low   : {100.0 * cs_time / span:5.1f} % of the span")
+	print(f"Bytes    : {100.0 * xfer / cs_time:5.1f} % of the CS low time")
+
+	# Per command
+	ops = {}
+	for c in cmds:
+		s = ops.setdefault(c['bytes'][0][2], [])
+		s.append((c['end'] - c['start'], len(c['bytes'])))
+
+	print(f"\n{'command':16s} {'count':>7s} {'bytes':>9s} {'total':>10s} {'min':>9s} {'avg':>9s} {'max':>9s} {'B/us':>6s}")
+	for op, s in sorted(ops.items(), key=lambda x: -sum([d for d, _ in x[1]])):
+		t = [d for d, _ in s]
+		n = sum([l for _, l in s])
+		name = f"{op:02x} {OPCODES.get(op, '?')}"
+		print(
+			f"{name:16s} {len(s):7d} {n:9d} {us(sum(t)):8.1f}us " +
+			f"{us(min(t)):7.2f}us {us(sum(t) / len(t)):7.2f}us {us(max(t)):7.2f}us {n / us(sum(t)):6.2f}"
+		)
+
+	# Histograms
+	histogram('Byte durations', dur)
+	histogram('Gaps between bytes', inter)
+	histogram('CS assert to first byte', lead)
+	histogram('Last byte to CS release', trail)
+	histogram('Idle between commands', idle)
+
+	# Raw events
+	if events:
+		print()
+		for c in cmds:
+			data = bytes([x[2] for x in c['bytes']])
+			print(f"{us(c['start']):12.2f}us {us(c['end'] - c['start']):9.2f}us  {data[:16].hex(' ')}{' ...' if len(data) > 16 else ''}")
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Capture and analyze the bootloader SPI flash traffic')
+	parser.add_argument('-S', '--serial', help='Serial number of the device to use')
+
+	sub = parser.add_subparsers(dest='cmd', required=True)
+
+	p = sub.add_parser('start', help='Clear and start a capture')
+	p.add_argument('--ring', action='store_true', help='Keep the last entries instead of stopping when full')
+
+	sub.add_parser('stop', help='Stop the capture')
+
+	p = sub.add_parser('report', help='Stop the capture and analyze it')
+	p.add_argument('-i', '--input', help='Analyze a saved trace instead')
+	p.add_argument('-o', '--output', help='Save the raw trace (JSON)')
+	p.add_argument('-e', '--events', action='store_true', help='Also list all the commands')
+
+	args = parser.parse_args()
+
+	# Saved trace
+	if args.cmd == 'report' and args.input:
+		with open(args.input, 'r') as fh:
+			t = json.load(fh)
+		report(t['entries'], t['elapsed'], args.events)
+		return 0
+
+	# Device
+	bl = NO2Bootloader(serial=args.serial)
+
+	if args.cmd == 'start':
+		bl.spi_trace_ctrl(True, oneshot=not args.ring)
+		return 0
+
+	# Stop, the content and write pointer are kept
+	bl.spi_trace_ctrl(False, clear=False)
+
+	if args.cmd == 'stop':
+		return 0
+
+	t = bl.get_spi_trace()
+	if t is None:
+		print("SPI trace not supported by the gateware (build with SPI_TRACE=1)", file=sys.stderr)
+		return 1
+
+	entries, elapsed = t
+
+	if args.output:
+		with open(args.output, 'w') as fh:
+			json.dump({ 'elapsed': elapsed, 'entries': entries }, fh)
+
+	report(entries, elapsed, args.events)
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
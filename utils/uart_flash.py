@@ -0,0 +1,295 @@
+#!/usr/bin/env python3
+#
+# Flash through the bootloader console UART, using its framed protocol
+# (see "UART flashing" in firmware/fw_dfu.c). Needs a bootloader built
+# with ENABLE_UART=1.
+#
+# Copyright (C) 2026 agent
+# SPDX-License-Identifier: MIT
+#
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+from no2image import load_image, plan_erase
+
+
+CLK_FREQ = 24e6
+DIV_MIN = 2		# Baud rate divider limits, same as the firmware
+DIV_MAX = 4095
+CRC_MAX = 4096		# Bytes per CRC command, same as the firmware
+
+SOF = 0xa5
+
+CMD_INFO    = 0x01
+CMD_READ    = 0x02
+CMD_PROGRAM = 0x03
+CMD_ERASE   = 0x04
+CMD_CRC     = 0x05
+CMD_BOOT    = 0x06
+CMD_BAUD    = 0x07
+NAK         = 0x7f
+
+STATUS = { 0: 'ok', 1: 'bad arguments', 2: 'unknown command', 3: 'bad sequence', 4: 'bad CRC' }
+
+
+class UARTFlashError(RuntimeError):
+	pass
+
+
+class UARTFlash:
+
+	TIMEOUT = 0.5
+	RETRIES = 5
+
+	def __init__(self, port, baud=1000000):
+		self.ser = serial.Serial(port, baud, timeout=0.05)
+		self.seq = 0
+		self.rxbuf = b''
+		self.info = self.get_info()
+
+	# Framing
+	# -------
+
+	@staticmethod
+	def frame(typ, seq, payload=b''):
+		hdr = struct.pack('<BBH', typ, seq, len(payload))
+		return bytes([SOF]) + hdr + payload + struct.pack('<I', zlib.crc32(hdr + payload))
+
+	def _recv(self, timeout):
+		"""Returns the next valid (type, seq, payload) or None on timeout.
+		Anything that isn't a valid frame (console output) is skipped"""
+		t_end = time.monotonic() + timeout
+
+		while True:
+			# Parse what we have
+			while True:
+				i = self.rxbuf.find(bytes([SOF]))
+				if i < 0:
+					self.rxbuf = b''
+					break
+				self.rxbuf = self.rxbuf[i:]
+				if len(self.rxbuf) < 5:
+					break
+				typ, seq, l = struct.unpack('<BBH', self.rxbuf[1:5])
+				if l > 512:
+					self.rxbuf = self.rxbuf[1:]
+					continue
+				if len(self.rxbuf) < 9 + l:
+					break
+				body, crc = self.rxbuf[1:5+l], struct.unpack('<I', self.rxbuf[5+l:9+l])[0]
+				if zlib.crc32(body) != crc:
+					self.rxbuf = self.rxbuf[1:]
+					continue
+				self.rxbuf = self.rxbuf[9+l:]
+				return typ, seq, body[4:]
+
+			# Get more
+			if time.monotonic() > t_end:
+				return None
+			self.rxbuf += self.ser.read(max(1, self.ser.in_waiting))
+
+	def transact(self, reqs, window=None, timeout=None):
+		"""Executes the list of (type, payload) requests, keeping up to
+		`window` of them in flight. Returns the list of response payloads
+		(status byte stripped)"""
+		window  = window or self.info['window']
+		timeout = timeout or self.TIMEOUT
+		base = self.seq
+		resps = [None] * len(reqs)
+		nxt = 0		# Next to send
+		done = 0	# First not acknowledged
+		retries = 0
+
+		while done < len(reqs):
+			# Fill the window
+			while (nxt < len(reqs)) and (nxt - done < window):
+				typ, payload = reqs[nxt]
+				self.ser.write(self.frame(typ, (base + nxt) & 0xff, payload))
+				nxt += 1
+
+			# Wait for the oldest one
+			r = self._recv(timeout)
+
+			if r is None or r[0] == NAK:
+				retries += 1
+				if retries > self.RETRIES:
+					raise UARTFlashError('No valid response' if r is None else f'NAK ({STATUS.get(r[2][0], r[2][0])})')
+
+				# Go back to the first one the device expects
+				if r is not None:
+					done = max(done, (r[2][1] - base) & 0xff)
+				nxt = done
+				self._drain()
+				continue
+
+			typ, seq, payload = r
+			idx = (seq - base) & 0xff
+			if (idx != done) or (typ != (reqs[idx][0] | 0x80)):
+				continue
+
+			if payload[0]:
+				raise UARTFlashError(f'Request {reqs[idx][0]:02x} failed ({STATUS.get(payload[0], payload[0])})')
+
+			resps[idx] = payload[1:]
+			done += 1
+			retries = 0
+
+		self.seq = (base + len(reqs)) & 0xff
+		return resps
+
+	def _drain(self):
+		time.sleep(0.01)
+		self.ser.reset_input_buffer()
+		self.rxbuf = b''
+
+	# Commands
+	# --------
+
+	def get_info(self):
+		# INFO resyncs the sequence number, retry until we get an answer
+		for i in range(self.RETRIES):
+			self.ser.write(self.frame(CMD_INFO, self.seq))
+			r = self._recv(self.TIMEOUT)
+			if r and (r[0] == CMD_INFO | 0x80) and (r[1] == self.seq) and (r[2][0] == 0):
+				self.seq = (self.seq + 1) & 0xff
+				v, w, md, sz, div = struct.unpack('<BBHIH', r[2][1:11])
+				return { 'version': v, 'window': w, 'max_data': md, 'size': sz, 'div': div }
+		raise UARTFlashError('Device not responding')
+
+	def set_baud(self, baud):
+		div = int(round(CLK_FREQ / baud)) - 2
+		if not (DIV_MIN <= div <= DIV_MAX):
+			raise ValueError(f'Baud rate out of range ({CLK_FREQ / (DIV_MAX + 2):.0f} - {CLK_FREQ / (DIV_MIN + 2):.0f})')
+		real = CLK_FREQ / (div + 2)
+		prev = self.ser.baudrate
+
+		self.transact([ (CMD_BAUD, struct.pack('<H', div)) ], window=1)
+
+		# Switch and confirm, the device reverts by itself if it doesn't
+		# get a valid frame at the new rate
+		time.sleep(0.01)
+		self.ser.baudrate = int(round(real))
+		self._drain()
+		try:
+			self.info = self.get_info()
+		except UARTFlashError:
+			self.ser.baudrate = prev
+			time.sleep(0.3)
+			self._drain()
+			self.info = self.get_info()
+			raise UARTFlashError(f'Baud rate {real:.0f} not usable, staying at {prev}')
+
+		return real
+
+	def read(self, addr, l):
+		md = self.info['max_data']
+		reqs = [ (CMD_READ, struct.pack('<IH', addr + o, min(md, l - o))) for o in range(0, l, md) ]
+		return b''.join(self.transact(reqs))
+
+	def erase(self, addr, l):
+		# Worst case is in the seconds for 64k
+		self.transact([ (CMD_ERASE, struct.pack('<II', addr, l)) ], window=1, timeout=1 + 3 * (l / 65536))
+
+	def program(self, addr, data, progress=None):
+		# Split in chunks within pages, skipping blank ones
+		reqs = []
+		while len(data):
+			l = min(self.info['max_data'], 256 - (addr & 0xff))
+			chunk, data = data[:l], data[l:]
+			if chunk.count(0xff) != len(chunk):
+				reqs.append( (CMD_PROGRAM, struct.pack('<I', addr) + chunk) )
+			addr += len(chunk)
+
+		# Batches, for progress
+		for i in range(0, len(reqs), 64):
+			self.transact(reqs[i:i+64])
+			if progress:
+				progress(min(i + 64, len(reqs)), len(reqs))
+
+	def crc(self, addr, l):
+		# Chained over several commands, each one passes the previous result
+		crc = 0
+		while l:
+			n = min(l, CRC_MAX)
+			crc = struct.unpack('<I', self.transact([ (CMD_CRC, struct.pack('<III', addr, n, crc)) ], window=1)[0])[0]
+			addr += n
+			l    -= n
+		return crc
+
+	def boot(self):
+		self.transact([ (CMD_BOOT, b'') ], window=1)
+
+	def write_segments(self, segments, progress=None):
+		for a, sz in plan_erase(segments):
+			self.erase(a, sz)
+
+		for addr, data in segments:
+			self.program(addr, data, progress)
+			if self.crc(addr, len(data)) != zlib.crc32(data):
+				raise UARTFlashError(f'Verification failed @0x{addr:08x}')
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Flash through the no2bootloader UART')
+	parser.add_argument('-p', '--port', required=True, help='Serial port')
+	parser.add_argument('-b', '--baud', type=float, help='Switch to this baud rate (up to 12M, limited by the link)')
+	parser.add_argument('-B', '--boot', action='store_true', help='Boot the application when done')
+	sub = parser.add_subparsers(dest='cmd')
+	sub.add_parser('info', help='Show device info')
+	p = sub.add_parser('read', help='Read flash to a file')
+	p.add_argument('addr', type=lambda x: int(x, 0))
+	p.add_argument('len', type=lambda x: int(x, 0))
+	p.add_argument('file')
+	p = sub.add_parser('write', help='Erase, program and verify an image (dense or sparse)')
+	p.add_argument('addr', type=lambda x: int(x, 0))
+	p.add_argument('file')
+	p = sub.add_parser('crc', help='CRC32 of a flash range')
+	p.add_argument('addr', type=lambda x: int(x, 0))
+	p.add_argument('len', type=lambda x: int(x, 0))
+	args = parser.parse_args()
+
+	uf = UARTFlash(args.port)
+
+	if args.baud:
+		print(f"Baud rate {uf.set_baud(args.baud):.0f}", file=sys.stderr)
+
+	if args.cmd == 'info':
+		i = uf.info
+		print(f"Protocol v{i['version']}, window {i['window']}, {i['max_data']} bytes per frame")
+		print(f"Flash {i['size'] >> 10} kB, baud {CLK_FREQ / (i['div'] + 2):.0f}")
+
+	elif args.cmd == 'read':
+		t0 = time.monotonic()
+		data = uf.read(args.addr, args.len)
+		t = time.monotonic() - t0
+		with open(args.file, 'wb') as fh:
+			fh.write(data)
+		print(f"Read {len(data)} bytes in {t:.2f} s ({len(data) / t / 1024:.1f} KiB/s)", file=sys.stderr)
+
+	elif args.cmd == 'write':
+		if args.addr & 4095:
+			raise RuntimeError('Address must be sector aligned !')
+		segments = load_image(args.file, args.addr)
+		size = sum([len(d) for a, d in segments])
+		t0 = time.monotonic()
+		uf.write_segments(segments, lambda d, t: print(f"\r{100 * d // t:3d}%", end='', file=sys.stderr))
+		t = time.monotonic() - t0
+		print(f"\nWrote {size} bytes in {t:.2f} s ({size / t / 1024:.1f} KiB/s)", file=sys.stderr)
+
+	elif args.cmd == 'crc':
+		print(f"{uf.crc(args.addr, args.len):08x}")
+
+	if args.boot:
+		uf.boot()
+
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main() or 0)
@@ -1,35 +1,71 @@
 #!/usr/bin/env python3
 
+import argparse
+import json
 import sys
+import time
 
 from no2bootloader import NO2Bootloader
+from no2image import load_image
 
 
-def main(argv0, fn, addr=0):
+def main():
+	parser = argparse.ArgumentParser(description='Write an image to flash through the bootloader vendor requests')
+	parser.add_argument('-d', '--delta', action='store_true', help='Only write the sectors that differ from the image')
+	parser.add_argument('--stats', action='store_true', help='Print per operation timing statistics')
+	parser.add_argument('--json', metavar='FILE', help='Write the timing statistics to this JSON file')
+	parser.add_argument('file')
+	parser.add_argument('addr', nargs='?', default='0', type=lambda x: int(x, 0))
+	args = parser.parse_args()
 
-	addr = int(addr, 0)
-	if addr & 4095:
-		raise RuntimeError('Address must be sector aligned !')
+	fn, addr = args.file, args.addr
+
+	# Unaligned writes are patches, which already skip unchanged sectors
+	if args.delta and (addr & 4095):
+		parser.error('--delta needs a sector aligned address (unaligned writes only touch changed sectors anyway)')
 
 	bl = NO2Bootloader()
 
-	with open(fn, 'rb') as fh:
-		data = fh.read()
+	segments = load_image(fn, addr)
+
+	bl.stats.reset()
+
+	# Not sector aligned : byte granular patch, for small updates
+	if addr & 4095:
+		for a, d in segments:
+			s, p, e = bl.flash_patch(a, d)
+			print(f"Patched {len(d)} bytes @0x{a:08x} : {s} sector(s) unchanged, {p} programmed, {e} erased", file=sys.stderr)
+
+	else:
+		# Rate limited, printing every page slows things down
+		last = 0
+
+		def progress(op, a, done, total):
+			nonlocal last
+			now = time.monotonic()
+			if (now - last) < 0.1 and op != 'done':
+				return
+			last = now
+			print(f"\r{op:8s} @0x{a:08x} {(100 * done // total) if total else 100:3d}%", end='', file=sys.stderr)
 
-	for ofs in range(0, len(data), 256):
-		if ofs & 4095 == 0:
-			print(f"Erasing @0x{addr+ofs:08x}", file=sys.stderr)
-			bl.flash_erase_4k(addr + ofs)
+		if args.delta:
+			n, total = bl.flash_write_delta(segments, progress)
+			print(f"\n{n} of {total} sector(s) changed", file=sys.stderr)
+		else:
+			bl.flash_write_segments(segments, progress)
+			print(file=sys.stderr)
 
-		chunk = data[ofs:ofs+256]
-		if len(chunk) < 256:
-			chunk = chunk + b'\x00' * (256 - len(chunk))
+	# Report
+	if args.stats:
+		print(bl.stats.summary(), file=sys.stderr)
 
-		print(f"Programming @0x{addr+ofs:08x}", file=sys.stderr)
-		bl.flash_program_page(addr + ofs, chunk)
+	if args.json:
+		with open(args.json, 'w') as fh:
+			json.dump(bl.stats.as_dict(), fh, indent='\t', sort_keys=True)
+			fh.write('\n')
 
 	return 0
 
 
 if __name__ == '__main__':
-	sys.exit(main(*sys.argv) or 0)
+	sys.exit(main() or 0)